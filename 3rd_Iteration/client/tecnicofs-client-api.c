@@ -9,7 +9,7 @@
 int sockfd; 
 socklen_t servlen, clilen;
 struct sockaddr_un serv_addr, client_addr;
-char message[MAX_INPUT_SIZE], buffer[BUFFER_SIZE];
+char message[MESSAGE_SIZE], buffer[BUFFER_SIZE];
 
 int setSockAddrUn(char *path, struct sockaddr_un *addr) {
 
@@ -140,6 +140,249 @@ int tfsPrint(char *outFilePath) {
   return atoi(buffer);
 }
 
+/*
+ * Requests server to print its statistics.
+ * Input:
+ *  - outFilePath: path of the output file
+ * Returns: command result
+ */
+int tfsStats(char *outFilePath) {
+
+  sprintf(message, "s %s", outFilePath);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsStats: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsStats: recvfrom error\n");
+    return FAIL;
+  } 
+
+  return atoi(buffer);
+}
+
+/*
+ * Requests server to open a directory handle.
+ * Input:
+ *  - path: path of the directory
+ *  - handle: pointer to store the handle
+ * Returns: SUCCESS or command result
+ */
+int tfsOpenDir(char *path, tfs_handle *handle) {
+
+  sprintf(message, "o %s", path);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsOpenDir: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsOpenDir: recvfrom error\n");
+    return FAIL;
+  } 
+
+  if (sscanf(buffer, "%d %u", &handle->inumber, &handle->generation) != 2)
+    return atoi(buffer);
+
+  return SUCCESS;
+}
+
+/*
+ * Requests server to create a node relative to a directory handle.
+ * Input:
+ *  - handle: handle of the directory the path starts at
+ *  - path: path of the node to create, relative to the directory
+ *  - nodeType: type of node (file or directory)
+ * Returns: command result
+ */
+int tfsCreateAt(tfs_handle handle, char *path, char nodeType) {
+
+  sprintf(message, "C %d:%u %s %c", handle.inumber, handle.generation, path, nodeType);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsCreateAt: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsCreateAt: recvfrom error\n");
+    return FAIL;
+  } 
+
+  return atoi(buffer);
+}
+
+/*
+ * Requests server to lookup a node relative to a directory handle.
+ * Input:
+ *  - handle: handle of the directory the path starts at
+ *  - path: path of the node to lookup, relative to the directory
+ * Returns: command result
+ */
+int tfsLookupAt(tfs_handle handle, char *path) {
+
+  sprintf(message, "L %d:%u %s", handle.inumber, handle.generation, path);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsLookupAt: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsLookupAt: recvfrom error\n");
+    return FAIL;
+  } 
+
+  return atoi(buffer);
+}
+
+/*
+ * Requests server to read part of a file.
+ * Input:
+ *  - path: path of the file
+ *  - offset: position of the first byte to read
+ *  - buffer: where to copy the bytes read to
+ *  - len: maximum number of bytes to read (at most MAX_DATA_SIZE)
+ * Returns: number of bytes read or command result
+ */
+int tfsRead(char *path, long offset, char *buffer, int len) {
+  char reply[BUFFER_SIZE + MAX_DATA_SIZE];
+  int result;
+  char *data;
+
+  sprintf(message, "r %s %ld %d", path, offset, len);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsRead: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, reply, sizeof(reply), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsRead: recvfrom error\n");
+    return FAIL;
+  } 
+
+  result = atoi(reply);
+
+  /* the bytes read follow the result */
+  if (result > 0 && (data = strchr(reply, ' ')) != NULL)
+    memcpy(buffer, data + 1, result);
+
+  return result;
+}
+
+/*
+ * Requests server to rebuild the path of an i-node, e.g. an inumber
+ * returned by tfsLookup.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - path: buffer of MAX_FILE_NAME characters to store the path
+ * Returns: length of the path or command result
+ */
+int tfsGetPath(int inumber, char *path) {
+  char reply[BUFFER_SIZE + MAX_FILE_NAME];
+  int result;
+  char *data;
+
+  sprintf(message, "n %d", inumber);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsGetPath: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, reply, sizeof(reply), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsGetPath: recvfrom error\n");
+    return FAIL;
+  } 
+
+  result = atoi(reply);
+
+  /* the path follows the result */
+  if (result > 0 && (data = strchr(reply, ' ')) != NULL) {
+    memcpy(path, data + 1, result);
+    path[result] = '\0';
+  }
+
+  return result;
+}
+
+/*
+ * Requests server to write to a file.
+ * Input:
+ *  - path: path of the file
+ *  - offset: position of the first byte to write
+ *  - data: text to write (at most MAX_DATA_SIZE bytes)
+ * Returns: number of bytes written or command result
+ */
+int tfsWrite(char *path, long offset, char *data) {
+
+  sprintf(message, "w %s %ld %s", path, offset, data);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsWrite: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsWrite: recvfrom error\n");
+    return FAIL;
+  } 
+
+  return atoi(buffer);
+}
+
+/*
+ * Requests server to write to the end of a file.
+ * Input:
+ *  - path: path of the file
+ *  - data: text to write (at most MAX_DATA_SIZE bytes)
+ * Returns: number of bytes written or command result
+ */
+int tfsAppend(char *path, char *data) {
+
+  sprintf(message, "a %s %s", path, data);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsAppend: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsAppend: recvfrom error\n");
+    return FAIL;
+  } 
+
+  return atoi(buffer);
+}
+
+/*
+ * Requests server to change the size of a file.
+ * Input:
+ *  - path: path of the file
+ *  - size: the new size
+ * Returns: command result
+ */
+int tfsTruncate(char *path, long size) {
+
+  sprintf(message, "t %s %ld", path, size);
+
+  if (sendto(sockfd, message, strlen(message)+1, 0, (struct sockaddr *) &serv_addr, servlen) < 0) {
+    perror("client tfsTruncate: sendto error\n");
+    return FAIL;
+  } 
+
+  if (recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *) &serv_addr, &servlen) < 0) {
+    perror("client tfsTruncate: recvfrom error\n");
+    return FAIL;
+  } 
+
+  return atoi(buffer);
+}
+
 /*
  * Mount the socket.
  * Input:
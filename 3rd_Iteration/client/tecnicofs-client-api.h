@@ -4,10 +4,19 @@
 #define SUCCESS 0
 #define FAIL -1
 
-#define BUFFER_SIZE 9
+#define BUFFER_SIZE 32
 
 #include "tecnicofs-api-constants.h"
 
+/* requests carry a path plus up to MAX_DATA_SIZE bytes of file data */
+#define MESSAGE_SIZE (MAX_INPUT_SIZE + MAX_DATA_SIZE)
+
+/* Directory handle: stays valid until the directory is deleted */
+typedef struct tfs_handle {
+  int inumber;
+  unsigned int generation;
+} tfs_handle;
+
 int tfsCreate(char *path, char nodeType);
 int tfsDelete(char *path);
 int tfsLookup(char *path);
@@ -15,6 +24,15 @@ int tfsMove(char *from, char *to);
 int tfsMount(char* serverName);
 void tfsUnmount();
 int tfsPrint(char *outFilePath);
+int tfsStats(char *outFilePath);
+int tfsOpenDir(char *path, tfs_handle *handle);
+int tfsCreateAt(tfs_handle handle, char *path, char nodeType);
+int tfsLookupAt(tfs_handle handle, char *path);
+int tfsRead(char *path, long offset, char *buffer, int len);
+int tfsWrite(char *path, long offset, char *data);
+int tfsAppend(char *path, char *data);
+int tfsTruncate(char *path, long size);
+int tfsGetPath(int inumber, char *path);
 void createClientSocket();
 
 #endif /* CLIENT_H */
@@ -1,10 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "tecnicofs-client-api.h"
 #include "../tecnicofs-api-constants.h"
 
 FILE* inputFile;
 char* serverName;
+/* directory handle used by the 'C' and 'L' commands, set by 'o' (starts as the root) */
+tfs_handle dirHandle = { 0, 0 };
 
 static void displayUsage (const char* appName) {
     printf("Usage: %s inputfile server_socket_name\n", appName);
@@ -33,12 +36,14 @@ void errorParse(){
 }
 
 void *processInput() {
-    char line[MAX_INPUT_SIZE];
+    char line[MESSAGE_SIZE];
 
     while (fgets(line, sizeof(line)/sizeof(char), inputFile)) {
         char op;
-        char arg1[MAX_INPUT_SIZE], arg2[MAX_INPUT_SIZE];
-        int res;
+        char arg1[MESSAGE_SIZE], arg2[MESSAGE_SIZE];
+        char data[MAX_DATA_SIZE];
+        int res, start = -1, len;
+        long offset;
 
         int numTokens = sscanf(line, "%c %s %s", &op, arg1, arg2);
 
@@ -57,6 +62,8 @@ void *processInput() {
                         res = tfsCreate(arg1, 'f');
                         if (!res)
                           printf("Created file: %s\n", arg1);
+                        else if (res == TECNICOFS_ERROR_NO_MEMORY)
+                          printf("Unable to create file: %s (server out of memory)\n", arg1);
                         else
                           printf("Unable to create file: %s\n", arg1);
                         break;
@@ -64,6 +71,8 @@ void *processInput() {
                         res = tfsCreate(arg1, 'd');
                         if (!res)
                           printf("Created directory: %s\n", arg1);
+                        else if (res == TECNICOFS_ERROR_NO_MEMORY)
+                          printf("Unable to create directory: %s (server out of memory)\n", arg1);
                         else
                           printf("Unable to create directory: %s\n", arg1);
                         break;
@@ -107,6 +116,97 @@ void *processInput() {
                 else
                     printf("Unable to print to: %s\n", arg1);
                 break;
+            case 's':
+                if(numTokens != 2)
+                    errorParse();
+                res = tfsStats(arg1);
+                if (!res)
+                    printf("Printed statistics to %s\n", arg1);
+                else
+                    printf("Unable to print statistics to: %s\n", arg1);
+                break;
+            case 'o':
+                if(numTokens != 2)
+                    errorParse();
+                res = tfsOpenDir(arg1, &dirHandle);
+                if (!res)
+                    printf("Opened directory: %s\n", arg1);
+                else
+                    printf("Unable to open directory: %s\n", arg1);
+                break;
+            case 'C':
+                if(numTokens != 3)
+                    errorParse();
+                res = tfsCreateAt(dirHandle, arg1, arg2[0]);
+                if (!res)
+                    printf("Created at handle %d: %s\n", dirHandle.inumber, arg1);
+                else if (res == TECNICOFS_ERROR_STALE_HANDLE)
+                    printf("Unable to create at handle %d: %s (stale handle)\n", dirHandle.inumber, arg1);
+                else if (res == TECNICOFS_ERROR_NO_MEMORY)
+                    printf("Unable to create at handle %d: %s (server out of memory)\n", dirHandle.inumber, arg1);
+                else
+                    printf("Unable to create at handle %d: %s\n", dirHandle.inumber, arg1);
+                break;
+            case 'L':
+                if(numTokens != 2)
+                    errorParse();
+                res = tfsLookupAt(dirHandle, arg1);
+                if (res >= 0)
+                    printf("Search at handle %d: %s found\n", dirHandle.inumber, arg1);
+                else if (res == TECNICOFS_ERROR_STALE_HANDLE)
+                    printf("Search at handle %d: %s not found (stale handle)\n", dirHandle.inumber, arg1);
+                else
+                    printf("Search at handle %d: %s not found\n", dirHandle.inumber, arg1);
+                break;
+            case 'r':
+                if(sscanf(line, "%*c %s %ld %d", arg1, &offset, &len) != 3 || len < 0 || len > MAX_DATA_SIZE)
+                    errorParse();
+                res = tfsRead(arg1, offset, data, len);
+                if (res >= 0)
+                    printf("Read from %s: %.*s\n", arg1, res, data);
+                else
+                    printf("Unable to read from: %s\n", arg1);
+                break;
+            case 'w':
+                /* the data is the rest of the line, after the offset and one space */
+                if(sscanf(line, "%*c %s %ld%n", arg1, &offset, &start) != 2 || start < 0)
+                    errorParse();
+                line[strcspn(line, "\n")] = '\0';
+                start += line[start] == ' ';
+                res = tfsWrite(arg1, offset, line + start);
+                if (res >= 0)
+                    printf("Wrote %d bytes to %s\n", res, arg1);
+                else
+                    printf("Unable to write to: %s\n", arg1);
+                break;
+            case 'a':
+                if(sscanf(line, "%*c %s%n", arg1, &start) != 1 || start < 0)
+                    errorParse();
+                line[strcspn(line, "\n")] = '\0';
+                start += line[start] == ' ';
+                res = tfsAppend(arg1, line + start);
+                if (res >= 0)
+                    printf("Appended %d bytes to %s\n", res, arg1);
+                else
+                    printf("Unable to append to: %s\n", arg1);
+                break;
+            case 't':
+                if(sscanf(line, "%*c %s %ld", arg1, &offset) != 2)
+                    errorParse();
+                res = tfsTruncate(arg1, offset);
+                if (!res)
+                    printf("Truncated %s to %ld bytes\n", arg1, offset);
+                else
+                    printf("Unable to truncate: %s\n", arg1);
+                break;
+            case 'n':
+                if(numTokens != 2 || sscanf(arg1, "%d", &res) != 1)
+                    errorParse();
+                if (tfsGetPath(res, arg2) >= 0)
+                    printf("Path of %s: %s\n", arg1, arg2);
+                else
+                    printf("Unable to find path of: %s\n", arg1);
+                break;
             case '#':
                 break;
             default: { /* error */
@@ -0,0 +1,154 @@
+/*
+ * Deep path benchmark: builds a tree of directories 4 wide and 10 deep
+ * (about 1.4M i-nodes), then looks up random leaves, first with the i-node
+ * table and slab pages on the heap, then carved from the huge-page arena.
+ * Prints the lookup throughput and, where perf events are available, the
+ * data TLB misses per lookup. Each run is a process of its own.
+ *
+ * Usage: bench/deepbench [arena_mb] [lookups]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "fs/operations.h"
+
+#define FAN 4
+#define DEPTH 10
+
+/*
+ * Opens a counter of the data TLB read misses of the calling thread.
+ * Returns: its descriptor, or -1 if perf events aren't available
+ */
+static int tlb_open() {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long tlb_read(int fd) {
+    long long misses;
+
+    if (fd < 0 || read(fd, &misses, sizeof(misses)) != sizeof(misses))
+        return -1;
+
+    return misses;
+}
+
+/*
+ * Writes the path of a leaf, its digits in base FAN picking each directory.
+ */
+static void leaf_path(long leaf, char *path) {
+    for (int d = 0; d < DEPTH; d++, leaf /= FAN)
+        path += sprintf(path, "/d%ld", leaf % FAN);
+}
+
+static void build(char *path, int depth) {
+    int len = strlen(path);
+
+    if (depth == DEPTH)
+        return;
+
+    for (int i = 0; i < FAN; i++) {
+        sprintf(path + len, "/d%d", i);
+
+        if (create(path, T_DIRECTORY) != SUCCESS) {
+            fprintf(stderr, "deepbench: unable to create %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        build(path, depth + 1);
+    }
+
+    path[len] = '\0';
+}
+
+/*
+ * Builds the tree and times the lookups. Runs in a child process.
+ */
+static void run(size_t arena_size, long lookups) {
+    char path[MAX_FILE_NAME] = "";
+    struct timespec start, end;
+    long leaves = 1, *keys;
+    long long before, after;
+    unsigned int seed = 1;
+    double seconds;
+    int fd;
+
+    for (int d = 0; d < DEPTH; d++)
+        leaves *= FAN;
+
+    if ((keys = malloc(lookups * sizeof(long))) == NULL) {
+        perror("deepbench");
+        exit(EXIT_FAILURE);
+    }
+
+    for (long i = 0; i < lookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        keys[i] = (seed >> 4) % leaves;
+    }
+
+    arena_set_size(arena_size);
+    init_fs();
+    build(path, 0);
+
+    fd = tlb_open();
+    before = tlb_read(fd);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < lookups; i++) {
+        leaf_path(keys[i], path);
+
+        if (lookup_aux(path) == FAIL) {
+            fprintf(stderr, "deepbench: %s not found\n", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    after = tlb_read(fd);
+
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-5s  %.2f M lookups/s  ", arena_size > 0 ? "arena" : "heap", lookups / seconds / 1e6);
+    if (before >= 0 && after >= 0)
+        printf("%.2f dTLB misses/lookup\n", (double) (after - before) / lookups);
+    else
+        printf("dTLB misses n/a\n");
+    arena_print_stats(stdout);
+
+    destroy_fs();
+    free(keys);
+}
+
+int main(int argc, char *argv[]) {
+    size_t arena_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+    long lookups = argc > 2 ? atol(argv[2]) : 2000000;
+
+    if (arena_mb == 0 || lookups <= 0) {
+        fprintf(stderr, "Usage: %s [arena_mb] [lookups]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int with_arena = 0; with_arena <= 1; with_arena++) {
+        pid_t pid;
+
+        fflush(stdout);
+        if ((pid = fork()) == 0) {
+            run(with_arena ? arena_mb << 20 : 0, lookups);
+            exit(EXIT_SUCCESS);
+        }
+
+        waitpid(pid, NULL, 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Directory benchmark: for directories of 3 to 4096 entries named like
+ * "file1234", fills enough directories to hold about 256k entries and
+ * prints the memory they take per entry (the Directory itself plus its
+ * slab blocks), against the 104 bytes of an entry with a fixed
+ * MAX_FILE_NAME name. Then times directory_find, in random directories,
+ * for names that are there and names that are not.
+ *
+ * Usage: bench/dirbench [finds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fs/operations.h"
+
+#define TOTAL_ENTRIES 262144
+
+/* an entry holding its name in a fixed char[MAX_FILE_NAME] */
+#define FIXED_ENTRY_SIZE (sizeof(int) + MAX_FILE_NAME)
+
+static const int sizes[] = {3, 8, 20, 64, 256, 4096};
+
+/* "file0" to "file8191": the names of the biggest directory and as many missing ones */
+static char names[2 * 4096][16];
+
+static long directory_bytes() {
+    return slab_category_bytes(SLAB_DIRECTORIES) + slab_category_bytes(SLAB_NAMES);
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end, long count) {
+    return ((end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec)) / count;
+}
+
+int main(int argc, char *argv[]) {
+    long finds = argc > 1 ? atol(argv[1]) : 1000000;
+
+    if (finds <= 0) {
+        fprintf(stderr, "Usage: %s [finds]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 2 * 4096; i++)
+        snprintf(names[i], sizeof(names[i]), "file%d", i);
+
+    init_fs();
+
+    printf("entries  bytes/entry  fixed/packed  hit ns  miss ns\n");
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s], count = TOTAL_ENTRIES / size;
+        Directory *dirs = malloc(count * sizeof(Directory));
+        long before = directory_bytes(), bytes;
+        struct timespec start, mid, end;
+        unsigned int seed = 1;
+        volatile int sink = 0;
+
+        if (dirs == NULL) {
+            perror("dirbench");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int d = 0; d < count; d++) {
+            directory_create(&dirs[d]);
+
+            for (int i = 0; i < size; i++) {
+                if (directory_add(&dirs[d], i + 1, names[i]) == FAIL) {
+                    fprintf(stderr, "dirbench: out of memory\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+
+        bytes = directory_bytes() - before + count * sizeof(Directory);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < finds; i++) {
+            seed = seed * 1103515245 + 12345;
+            sink += directory_find(&dirs[(seed >> 4) % count], names[(seed >> 8) % size]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &mid);
+        for (long i = 0; i < finds; i++) {
+            seed = seed * 1103515245 + 12345;
+            sink += directory_find(&dirs[(seed >> 4) % count], names[size + (seed >> 8) % size]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        printf("%7d  %11.1f  %11.1fx  %6.0f  %7.0f\n", size, (double) bytes / (count * size),
+               (double) FIXED_ENTRY_SIZE * count * size / bytes,
+               elapsed_ns(&start, &mid, finds), elapsed_ns(&mid, &end, finds));
+
+        for (int d = 0; d < count; d++)
+            directory_destroy(&dirs[d]);
+        free(dirs);
+    }
+
+    destroy_fs();
+
+    return 0;
+}
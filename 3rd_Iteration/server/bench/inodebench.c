@@ -0,0 +1,79 @@
+/*
+ * I-node allocation benchmark: creates count i-nodes (10M by default) with
+ * 1, 2, 4, ... max_threads threads and prints the allocation throughput
+ * for each thread count. Each thread count runs in a process of its own,
+ * so every run grows the table from empty.
+ *
+ * Usage: bench/inodebench [count] [max_threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "fs/operations.h"
+
+static long per_thread;
+
+static void *create_inodes(void *arg) {
+
+    for (long i = 0; i < per_thread; i++) {
+        if (inode_create(T_FILE, FS_ROOT) == FAIL) {
+            fprintf(stderr, "inodebench: i-node table full\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Creates the i-nodes with the given number of threads and prints the
+ * throughput. Runs in a child process.
+ */
+static void run(long count, int threads) {
+    pthread_t tid[threads];
+    struct timespec start, end;
+    double seconds;
+
+    per_thread = count / threads;
+    init_fs();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tid[i], NULL, create_inodes, NULL);
+    for (int i = 0; i < threads; i++)
+        pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("threads %2d: %ld i-nodes in %.3f s, %.2f M i-nodes/s\n",
+           threads, per_thread * threads, seconds, per_thread * threads / seconds / 1e6);
+
+    destroy_fs();
+}
+
+int main(int argc, char *argv[]) {
+    long count = argc > 1 ? atol(argv[1]) : 10000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+
+    if (count <= 0 || max_threads <= 0) {
+        fprintf(stderr, "Usage: %s [count] [max_threads]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        pid_t pid;
+
+        fflush(stdout);
+        if ((pid = fork()) == 0) {
+            run(count, threads);
+            exit(EXIT_SUCCESS);
+        }
+
+        waitpid(pid, NULL, 0);
+    }
+
+    return 0;
+}
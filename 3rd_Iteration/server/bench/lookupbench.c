@@ -0,0 +1,85 @@
+/*
+ * Lookup benchmark: builds a wide tree of width directories at the root,
+ * each holding width directories (64 by default), then runs lookup_aux
+ * on random leaf paths with 1, 2, 4, ... 64 threads and prints the
+ * aggregate throughput for each thread count.
+ *
+ * Usage: bench/lookupbench [width] [lookups_per_thread]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "fs/operations.h"
+
+#define MAX_THREADS 64
+
+static char (*paths)[MAX_FILE_NAME];
+static int path_count;
+static long per_thread;
+
+static void *lookup_paths(void *arg) {
+    unsigned int seed = (unsigned int) (long) arg * 7919 + 1;
+
+    for (long i = 0; i < per_thread; i++) {
+        seed = seed * 1103515245 + 12345;
+
+        if (lookup_aux(paths[(seed >> 8) % path_count]) == FAIL) {
+            fprintf(stderr, "lookupbench: path not found\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 64;
+    char name[MAX_FILE_NAME];
+
+    per_thread = argc > 2 ? atol(argv[2]) : 1000000;
+
+    if (width <= 0 || per_thread <= 0) {
+        fprintf(stderr, "Usage: %s [width] [lookups_per_thread]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    path_count = width * width;
+    if ((paths = malloc(path_count * sizeof(*paths))) == NULL) {
+        perror("lookupbench");
+        exit(EXIT_FAILURE);
+    }
+
+    init_fs();
+
+    for (int i = 0; i < width; i++) {
+        snprintf(name, sizeof(name), "/d%d", i);
+        create(name, T_DIRECTORY);
+
+        for (int j = 0; j < width; j++) {
+            snprintf(paths[i * width + j], MAX_FILE_NAME, "/d%d/e%d", i, j);
+            create(paths[i * width + j], T_DIRECTORY);
+        }
+    }
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        pthread_t tid[MAX_THREADS];
+        struct timespec start, end;
+        double seconds;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < threads; i++)
+            pthread_create(&tid[i], NULL, lookup_paths, (void *) i);
+        for (int i = 0; i < threads; i++)
+            pthread_join(tid[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("threads %2d: %.2f M lookups/s\n", threads, per_thread * threads / seconds / 1e6);
+    }
+
+    destroy_fs();
+    free(paths);
+
+    return 0;
+}
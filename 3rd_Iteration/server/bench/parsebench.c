@@ -0,0 +1,85 @@
+/*
+ * Parse and resolve benchmark: builds a chain of directories 32 deep, each
+ * level holding 40 of them, and for paths of depth 1 to 32 prints the
+ * nanoseconds it takes to parse the path (context_parse), to parse it and
+ * resolve it with lookup (dentry cache first), and to parse it and walk it
+ * under locks (lookup_from).
+ *
+ * Usage: bench/parsebench [count]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fs/operations.h"
+
+#define MAX_DEPTH 32
+#define LEVEL_WIDTH 40
+
+static const int depths[] = {1, 2, 3, 4, 6, 8, 12, 16, 24, 32};
+
+static char paths[MAX_DEPTH + 1][MAX_FILE_NAME];
+
+static double elapsed_ns(struct timespec *start, struct timespec *end, long count) {
+    return ((end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec)) / count;
+}
+
+int main(int argc, char *argv[]) {
+    long count = argc > 1 ? atol(argv[1]) : 400000;
+    char name[MAX_FILE_NAME];
+    op_context_t *context;
+    op_path_t *path;
+    volatile int sink = 0;
+
+    if (count <= 0) {
+        fprintf(stderr, "Usage: %s [count]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    init_fs();
+    context = context_get();
+    path = &context->paths[0];
+
+    /* two-letter names, so each level is searched by hash */
+    for (int d = 1; d <= MAX_DEPTH; d++) {
+        for (int k = 0; k < LEVEL_WIDTH; k++) {
+            snprintf(name, sizeof(name), "%s/%c%c", paths[d - 1], 'a' + k % 26, 'a' + k / 26);
+            create(name, T_DIRECTORY);
+        }
+        snprintf(paths[d], MAX_FILE_NAME, "%s/%c%c", paths[d - 1], 'a' + d % 26, 'a' + d / 26);
+    }
+
+    printf("depth  parse ns  parse+cached ns  parse+walk ns\n");
+
+    for (int i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        char *walked = paths[depths[i]];
+        struct timespec times[4];
+
+        clock_gettime(CLOCK_MONOTONIC, &times[0]);
+        for (long n = 0; n < count; n++)
+            sink += context_parse(path, walked);
+        clock_gettime(CLOCK_MONOTONIC, &times[1]);
+
+        for (long n = 0; n < count; n++) {
+            context_begin(context, OP_LOOKUP);
+            context_parse(path, walked);
+            sink += lookup(context, path, path->count, LOOKUP);
+            context_unlock_all(context);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &times[2]);
+
+        for (long n = 0; n < count; n++) {
+            context_begin(context, OP_LOOKUP);
+            context_parse(path, walked);
+            sink += lookup_from(context, FS_ROOT, path, path->count, LOOKUP);
+            context_unlock_all(context);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &times[3]);
+
+        printf("%5d  %8.0f  %15.0f  %13.0f\n", depths[i], elapsed_ns(&times[0], &times[1], count),
+               elapsed_ns(&times[1], &times[2], count), elapsed_ns(&times[2], &times[3], count));
+    }
+
+    destroy_fs();
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Name scan benchmark: for 4, 20, 64 and 256 names like "file1234", times
+ * finding a name by scanning their hashes with the scalar, SSE2 and AVX2
+ * kernels of the directories, against comparing every name with strcmp,
+ * and prints the nanoseconds per search for names that are there and
+ * names that are not. Kernels the CPU does not support are skipped.
+ *
+ * Usage: bench/scanbench [searches]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fs/operations.h"
+
+#define MAX_NAMES 256
+
+static const int sizes[] = {4, 20, 64, 256};
+
+static const struct {
+    const char *name;
+    int kernel;
+} kernels[] = {
+    {"scalar", DIR_SCAN_SCALAR},
+    {"sse2", DIR_SCAN_SSE2},
+    {"avx2", DIR_SCAN_AVX2},
+};
+
+/* "file0" to "file511": the names searched and as many missing ones */
+static char names[2 * MAX_NAMES][16];
+static uint32_t hashes[2 * MAX_NAMES];
+
+static long searches;
+static volatile int sink;
+
+static double elapsed_ns(struct timespec *start, struct timespec *end, long count) {
+    return ((end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec)) / count;
+}
+
+/*
+ * Times searches for the names from first, chosen at random among size.
+ * Input:
+ *  - scan: the kernel, or NULL to compare the names with strcmp
+ */
+static double time_scan(hash_scan_t scan, int size, int first) {
+    struct timespec start, end;
+    unsigned int seed = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < searches; i++) {
+        int searched = first + ((seed = seed * 1103515245 + 12345) >> 8) % size;
+
+        if (scan != NULL) {
+            /* the hash is compared, then the name, as directories do */
+            int position = 0;
+
+            while ((position += scan(hashes + position, size - position, hashes[searched])) < size &&
+              strcmp(names[position], names[searched]) != 0)
+                position++;
+            sink += position;
+        } else {
+            int position;
+
+            for (position = 0; position < size; position++) {
+                if (strcmp(names[position], names[searched]) == 0)
+                    break;
+            }
+            sink += position;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed_ns(&start, &end, searches);
+}
+
+int main(int argc, char *argv[]) {
+    searches = argc > 1 ? atol(argv[1]) : 10000000;
+
+    if (searches <= 0) {
+        fprintf(stderr, "Usage: %s [searches]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 2 * MAX_NAMES; i++) {
+        snprintf(names[i], sizeof(names[i]), "file%d", i);
+        hashes[i] = name_hash(names[i], strlen(names[i]));
+    }
+
+    printf("entries  kernel  hit ns  miss ns\n");
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s];
+
+        for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            hash_scan_t scan = directory_scan_kernel(kernels[k].kernel);
+
+            if (scan != NULL)
+                printf("%7d  %6s  %6.1f  %7.1f\n", size, kernels[k].name,
+                       time_scan(scan, size, 0), time_scan(scan, size, MAX_NAMES));
+        }
+
+        printf("%7d  %6s  %6.1f  %7.1f\n", size, "strcmp",
+               time_scan(NULL, size, 0), time_scan(NULL, size, MAX_NAMES));
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Small file benchmark: for file sizes of 8 to 1024 bytes, creates count
+ * files in one directory and writes each one, reads them all back, then
+ * deletes them, and prints the nanoseconds per file of each pass (the best
+ * of a few rounds). Sizes up to FILE_INLINE_SIZE are kept in the i-node.
+ *
+ * Usage: bench/smallbench [count]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fs/operations.h"
+
+#define ROUNDS 3
+#define MAX_SIZE 1024
+
+static const int sizes[] = {8, 32, 64, 128, 256, 1024};
+
+static double elapsed_ns(struct timespec *start, struct timespec *end, long count) {
+    return ((end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec)) / count;
+}
+
+int main(int argc, char *argv[]) {
+    long count = argc > 1 ? atol(argv[1]) : 100000;
+    char data[MAX_SIZE], buffer[MAX_SIZE];
+    char (*paths)[24];
+
+    if (count <= 0) {
+        fprintf(stderr, "Usage: %s [count]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((paths = malloc(count * sizeof(*paths))) == NULL) {
+        perror("smallbench");
+        exit(EXIT_FAILURE);
+    }
+
+    for (long i = 0; i < count; i++)
+        snprintf(paths[i], sizeof(paths[i]), "/d/f%ld", i);
+    memset(data, 'x', sizeof(data));
+
+    init_fs();
+    create("/d", T_DIRECTORY);
+
+    printf("size  create+write ns  read ns  delete ns\n");
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s];
+        double best[3] = {0, 0, 0};
+
+        for (int round = 0; round < ROUNDS; round++) {
+            struct timespec times[4];
+            double pass[3];
+
+            clock_gettime(CLOCK_MONOTONIC, &times[0]);
+            for (long i = 0; i < count; i++) {
+                if (create(paths[i], T_FILE) != SUCCESS || write_file(paths[i], 0, data, size) != size) {
+                    fprintf(stderr, "smallbench: unable to write %s\n", paths[i]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &times[1]);
+            for (long i = 0; i < count; i++) {
+                if (read_file(paths[i], 0, buffer, size) != size) {
+                    fprintf(stderr, "smallbench: unable to read %s\n", paths[i]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &times[2]);
+            for (long i = 0; i < count; i++)
+                delete(paths[i]);
+            clock_gettime(CLOCK_MONOTONIC, &times[3]);
+
+            for (int p = 0; p < 3; p++) {
+                pass[p] = elapsed_ns(&times[p], &times[p + 1], count);
+                if (round == 0 || pass[p] < best[p])
+                    best[p] = pass[p];
+            }
+        }
+
+        printf("%4d  %15.0f  %7.0f  %9.0f\n", size, best[0], best[1], best[2]);
+    }
+
+    destroy_fs();
+    free(paths);
+
+    return 0;
+}
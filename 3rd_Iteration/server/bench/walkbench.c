@@ -0,0 +1,123 @@
+/*
+ * Read-only walk benchmark: builds /d%d/e%d/f%d, width directories wide at
+ * each level (48 by default, far more paths than the path cache holds),
+ * then looks up random leaves with 1, 2, 4, ... 64 threads, once through
+ * lookup_aux, which walks optimistically and falls back to locks, and once
+ * with the locked walk alone (lookup_from). Prints the aggregate
+ * throughput of both for each thread count.
+ *
+ * Usage: bench/walkbench [width] [lookups_per_thread]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "fs/operations.h"
+
+#define MAX_THREADS 64
+
+static char (*paths)[MAX_FILE_NAME];
+static int path_count;
+static long per_thread;
+
+static void *walk_optimistic(void *arg) {
+    unsigned int seed = (unsigned int) (long) arg * 7919 + 1;
+
+    for (long i = 0; i < per_thread; i++) {
+        seed = seed * 1103515245 + 12345;
+
+        if (lookup_aux(paths[(seed >> 8) % path_count]) == FAIL) {
+            fprintf(stderr, "walkbench: path not found\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return NULL;
+}
+
+static void *walk_locked(void *arg) {
+    unsigned int seed = (unsigned int) (long) arg * 7919 + 1;
+    op_context_t *context = context_get();
+    op_path_t *path = &context->paths[0];
+
+    for (long i = 0; i < per_thread; i++) {
+        seed = seed * 1103515245 + 12345;
+
+        context_begin(context, OP_LOOKUP);
+        context_parse(path, paths[(seed >> 8) % path_count]);
+        if (lookup_from(context, FS_ROOT, path, path->count, LOOKUP) == FAIL) {
+            fprintf(stderr, "walkbench: path not found\n");
+            exit(EXIT_FAILURE);
+        }
+        context_unlock_all(context);
+    }
+
+    return NULL;
+}
+
+/*
+ * Runs a walk with the given number of threads.
+ * Returns: the aggregate throughput, in lookups per second
+ */
+static double run(void *(*walk)(void *), int threads) {
+    pthread_t tid[MAX_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < threads; i++)
+        pthread_create(&tid[i], NULL, walk, (void *) i);
+    for (int i = 0; i < threads; i++)
+        pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return per_thread * threads / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : 48;
+    char name[MAX_FILE_NAME];
+
+    per_thread = argc > 2 ? atol(argv[2]) : 200000;
+
+    if (width <= 0 || per_thread <= 0) {
+        fprintf(stderr, "Usage: %s [width] [lookups_per_thread]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    path_count = width * width * width;
+    if ((paths = malloc(path_count * sizeof(*paths))) == NULL) {
+        perror("walkbench");
+        exit(EXIT_FAILURE);
+    }
+
+    init_fs();
+
+    for (int i = 0; i < width; i++) {
+        snprintf(name, sizeof(name), "/d%d", i);
+        create(name, T_DIRECTORY);
+
+        for (int j = 0; j < width; j++) {
+            snprintf(name, sizeof(name), "/d%d/e%d", i, j);
+            create(name, T_DIRECTORY);
+
+            for (int k = 0; k < width; k++) {
+                snprintf(paths[(i * width + j) * width + k], MAX_FILE_NAME, "/d%d/e%d/f%d", i, j, k);
+                create(paths[(i * width + j) * width + k], T_DIRECTORY);
+            }
+        }
+    }
+
+    printf("threads  optimistic M/s  locked M/s\n");
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double optimistic = run(walk_optimistic, threads);
+        double locked = run(walk_locked, threads);
+
+        printf("%7d  %15.2f  %10.2f\n", threads, optimistic / 1e6, locked / 1e6);
+    }
+
+    destroy_fs();
+    free(paths);
+
+    return 0;
+}
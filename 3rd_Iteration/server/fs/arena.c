@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+static const char *arena_mode_names[] = { "none", "hugetlb", "thp" };
+
+/* requested size in bytes, 0 for no arena */
+size_t arena_size = 0;
+
+/* reserved region and how much of it was handed out */
+char *arena_base = NULL;
+size_t arena_used = 0;
+int arena_mode = ARENA_NONE;
+
+/*
+ * Sets the size of the arena. Must be called before arena_init.
+ * Input:
+ *  - bytes: size of the arena, 0 for none
+ */
+void arena_set_size(size_t bytes) {
+    arena_size = (bytes + ARENA_HUGE_PAGE_SIZE - 1) & ~((size_t) ARENA_HUGE_PAGE_SIZE - 1);
+}
+
+/*
+ * Reserves the arena, with explicit huge pages if the system has enough
+ * of them, or else with regular pages aligned to a huge page and advised
+ * for transparent huge pages. If neither works the arena stays disabled.
+ */
+void arena_init() {
+    char *region;
+
+    arena_used = 0;
+    arena_base = NULL;
+    arena_mode = ARENA_NONE;
+
+    if (arena_size == 0)
+        return;
+
+#ifdef MAP_HUGETLB
+    region = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED) {
+        arena_base = region;
+        arena_mode = ARENA_HUGETLB;
+        return;
+    }
+#endif
+
+    /* one extra huge page to align the start, the excess is unmapped */
+    region = mmap(NULL, arena_size + ARENA_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("Warning: unable to reserve arena, using the heap");
+        return;
+    }
+
+    arena_base = (char *) (((uintptr_t) region + ARENA_HUGE_PAGE_SIZE - 1) &
+                           ~((uintptr_t) ARENA_HUGE_PAGE_SIZE - 1));
+    if (arena_base != region)
+        munmap(region, arena_base - region);
+    munmap(arena_base + arena_size, region + ARENA_HUGE_PAGE_SIZE - arena_base);
+
+#ifdef MADV_HUGEPAGE
+    /* without THP support this fails and the arena is just contiguous */
+    madvise(arena_base, arena_size, MADV_HUGEPAGE);
+#endif
+
+    arena_mode = ARENA_THP;
+}
+
+/*
+ * Releases the arena. Blocks carved from it become invalid.
+ */
+void arena_destroy() {
+    if (arena_base != NULL)
+        munmap(arena_base, arena_size);
+
+    arena_base = NULL;
+    arena_used = 0;
+    arena_mode = ARENA_NONE;
+}
+
+/*
+ * Carves a block from the arena.
+ * Input:
+ *  - size: size of the block, in bytes
+ *  - alignment: power of two the block's address must be a multiple of
+ * Returns: the block, or NULL if there is no arena or it is full
+ */
+void *arena_alloc(size_t size, size_t alignment) {
+    size_t used = __atomic_load_n(&arena_used, __ATOMIC_RELAXED), start;
+
+    if (arena_base == NULL)
+        return NULL;
+
+    do {
+        start = (used + alignment - 1) & ~(alignment - 1);
+
+        if (start + size > arena_size)
+            return NULL;
+    } while (!__atomic_compare_exchange_n(&arena_used, &used, start + size, 1,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return arena_base + start;
+}
+
+/*
+ * Tells if a block was carved from the arena, and so must not be freed.
+ */
+int arena_contains(void *block) {
+    return arena_base != NULL && (char *) block >= arena_base &&
+           (char *) block < arena_base + arena_size;
+}
+
+/*
+ * Prints how the arena is backed and how much of it is used.
+ * Input:
+ *  - fp: pointer to output file
+ */
+void arena_print_stats(FILE *fp) {
+    if (arena_size == 0)
+        return;
+
+    fprintf(fp, "arena: %s %zu/%zu\n", arena_mode_names[arena_mode],
+            __atomic_load_n(&arena_used, __ATOMIC_RELAXED), arena_size);
+}
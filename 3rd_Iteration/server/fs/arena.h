@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Optional region the i-node table segments and the slab pages are carved
+ * from, so the hot metadata of a big tree sits in a few huge pages instead
+ * of being spread across the heap. The region is reserved at once and
+ * only backed by memory as it is used. Blocks are never given back before
+ * arena_destroy; once the region is full, callers fall back to the heap.
+ */
+
+/* size of a huge page, the arena is rounded up to a multiple of it */
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* how the arena is backed */
+#define ARENA_NONE 0     /* disabled, or the region couldn't be reserved */
+#define ARENA_HUGETLB 1  /* explicit huge pages (MAP_HUGETLB) */
+#define ARENA_THP 2      /* regular pages, with transparent huge pages advised */
+
+void arena_set_size(size_t bytes);
+void arena_init();
+void arena_destroy();
+void *arena_alloc(size_t size, size_t alignment);
+int arena_contains(void *block);
+void arena_print_stats(FILE *fp);
+
+#endif /* ARENA_H */
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "state.h"
+#include "context.h"
+
+static const char *context_op_names[OP_COUNT] = {"lookup", "create", "delete", "move", "file"};
+
+/* every thread that ever ran an operation */
+op_context_t *context_threads = NULL;
+pthread_mutex_t context_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread op_context_t *context_self = NULL;
+
+/*
+ * Returns the calling thread's context, allocating it on first use.
+ */
+op_context_t *context_get() {
+
+    if (context_self != NULL)
+        return context_self;
+
+    if ((context_self = calloc(1, sizeof(op_context_t))) == NULL) {
+        perror("Error: unable to allocate operation context.\n");
+        exit(EXIT_FAILURE);
+    }
+    slab_charge_fixed(sizeof(op_context_t), SLAB_CACHES);
+
+    pthread_mutex_lock(&context_threads_mutex);
+    context_self->next = context_threads;
+    context_threads = context_self;
+    pthread_mutex_unlock(&context_threads_mutex);
+
+    return context_self;
+}
+
+/*
+ * Starts an operation. The context must hold no lock.
+ * Input:
+ *  - context: the calling thread's context
+ *  - op: one of OP_*, for the statistics
+ */
+void context_begin(op_context_t *context, int op) {
+    context->op = op;
+    context->stats[op].ops++;
+}
+
+/*
+ * Splits a path into its names, ignoring leading, trailing and repeated
+ * slashes, so "a/b" and "/a//b/" both have 2. The path is read once: each
+ * character is copied and hashed as it is scanned.
+ * Input:
+ *  - path: where to store the names
+ *  - name: the path
+ * Returns: number of names, or FAIL if the path is too long
+ */
+int context_parse(op_path_t *path, char *name) {
+    op_name_t *current = NULL;
+    uint32_t hash = 0;
+    int i;
+
+    path->count = 0;
+    path->parent_length = 0;
+
+    for (i = 0; name[i] != '\0'; i++) {
+        if (i == MAX_FILE_NAME - 1) {
+            path->count = 0;
+            return FAIL;
+        }
+
+        if (name[i] == '/') {
+            path->buffer[i] = '\0';
+
+            if (current != NULL) {
+                current->len = path->buffer + i - current->name;
+                current->hash = NAME_HASH_END(hash);
+                current = NULL;
+            }
+            continue;
+        }
+
+        if (current == NULL) {
+            current = &path->names[path->count++];
+            current->name = path->buffer + i;
+            hash = NAME_HASH_INIT;
+        }
+
+        path->buffer[i] = name[i];
+        hash = NAME_HASH_STEP(hash, name[i]);
+    }
+
+    path->buffer[i] = '\0';
+
+    if (current != NULL) {
+        current->len = path->buffer + i - current->name;
+        current->hash = NAME_HASH_END(hash);
+    }
+
+    /* up to the end of the parent's name, so "/a//b" gives "/a" */
+    if (path->count > 1) {
+        op_name_t *parent = &path->names[path->count - 2];
+
+        path->parent_length = parent->name + parent->len - path->buffer;
+    }
+
+    return path->count;
+}
+
+#ifdef LOCK_DEBUG
+/*
+ * Aborts if locking an i-node now could deadlock: if it is held already,
+ * or lies above an i-node held, as walks only ever wait going down.
+ */
+static void context_check_order(op_context_t *context, int inumber) {
+
+    for (int i = 0; i < context->locked_count; i++) {
+        if (context->locked[i] == inumber) {
+            fprintf(stderr, "lock order: %s locks i-node %d twice\n",
+                    context_op_names[context->op], inumber);
+            abort();
+        }
+
+        if (inode_is_ancestor(inumber, context->locked[i]) == SUCCESS) {
+            fprintf(stderr, "lock order: %s locks i-node %d while holding %d below it\n",
+                    context_op_names[context->op], inumber, context->locked[i]);
+            abort();
+        }
+    }
+}
+#endif
+
+/*
+ * Locks an i-node and adds it to the lock set of the context.
+ * Input:
+ *  - context: the calling thread's context
+ *  - inumber: identifier of the i-node
+ *  - rw: READ or WRITE
+ */
+void context_lock(op_context_t *context, int inumber, char rw) {
+    op_stats_t *stats = &context->stats[context->op];
+    struct timespec start, end;
+
+    if (context->locked_count == CONTEXT_MAX_LOCKED) {
+        fprintf(stderr, "Error: %s holds too many locks\n", context_op_names[context->op]);
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef LOCK_DEBUG
+    context_check_order(context, inumber);
+#endif
+
+    /* the clock is only read when the lock has to be waited for */
+    if (trylock(inumber, rw) == FAIL) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        lock(inumber, rw);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        stats->contended++;
+        stats->wait += (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+    }
+
+    context->locked[context->locked_count++] = inumber;
+    stats->taken++;
+
+    if (context->locked_count > stats->held_max)
+        stats->held_max = context->locked_count;
+}
+
+/*
+ * Unlocks one of the i-nodes of the lock set.
+ * Input:
+ *  - context: the calling thread's context
+ *  - inumber: identifier of the i-node
+ */
+void context_unlock(op_context_t *context, int inumber) {
+
+    for (int i = context->locked_count - 1; i >= 0; i--) {
+        if (context->locked[i] == inumber) {
+            unlock(inumber);
+            context->locked[i] = context->locked[--context->locked_count];
+            return;
+        }
+    }
+}
+
+/*
+ * Unlocks every i-node of the lock set, the last locked first.
+ */
+void context_unlock_all(op_context_t *context) {
+
+    while (context->locked_count > 0)
+        unlock(context->locked[--context->locked_count]);
+}
+
+/*
+ * Checks if an i-node is in the lock set.
+ * Returns: SUCCESS if it is, FAIL otherwise
+ */
+int context_holds(op_context_t *context, int inumber) {
+
+    for (int i = 0; i < context->locked_count; i++) {
+        if (context->locked[i] == inumber)
+            return SUCCESS;
+    }
+
+    return FAIL;
+}
+
+/*
+ * Takes the rename lock (see namespace_rename_lock), which comes before
+ * every i-node lock.
+ */
+void context_rename_lock(op_context_t *context) {
+
+#ifdef LOCK_DEBUG
+    if (context->locked_count > 0 || context->renaming) {
+        fprintf(stderr, "lock order: %s takes the rename lock holding %d i-nodes%s\n",
+                context_op_names[context->op], context->locked_count,
+                context->renaming ? " and the rename lock" : "");
+        abort();
+    }
+#endif
+
+    namespace_rename_lock();
+    context->renaming = 1;
+}
+
+void context_rename_unlock(op_context_t *context) {
+    context->renaming = 0;
+    namespace_rename_unlock();
+}
+
+/*
+ * Prints the lock statistics of each operation. Counters of other threads
+ * are read without synchronization, so the result is a close estimate.
+ * Input:
+ *  - fp: pointer to output file
+ */
+void context_print_stats(FILE *fp) {
+    op_stats_t total[OP_COUNT];
+
+    memset(total, 0, sizeof(total));
+
+    pthread_mutex_lock(&context_threads_mutex);
+    for (op_context_t *context = context_threads; context != NULL; context = context->next) {
+        for (int op = 0; op < OP_COUNT; op++) {
+            total[op].ops += context->stats[op].ops;
+            total[op].taken += context->stats[op].taken;
+            total[op].contended += context->stats[op].contended;
+            total[op].wait += context->stats[op].wait;
+            if (context->stats[op].held_max > total[op].held_max)
+                total[op].held_max = context->stats[op].held_max;
+        }
+    }
+    pthread_mutex_unlock(&context_threads_mutex);
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        fprintf(fp, "locks: %s ops %ld taken %ld contended %ld wait %ld us held max %d\n",
+                context_op_names[op], total[op].ops, total[op].taken, total[op].contended,
+                total[op].wait / 1000, total[op].held_max);
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../tecnicofs-api-constants.h"
+
+/*
+ * Per-thread operation context: the i-nodes an operation holds locked,
+ * its paths already split into names, and lock statistics. Each thread
+ * keeps one for its whole life and reuses it for every operation, so
+ * nothing is allocated or cleared per operation: the lock set is emptied
+ * by context_unlock_all and the paths are overwritten by context_parse.
+ *
+ * Built with -DLOCK_DEBUG (make EXTRA_CFLAGS=-DLOCK_DEBUG), every lock
+ * taken is checked against the lock order: the rename lock before any
+ * i-node, and never an i-node above one already held.
+ */
+
+/* most i-nodes an operation holds at once: a move holds both parents and the i-node moved */
+#define CONTEXT_MAX_LOCKED 4
+
+/* most names a path of MAX_FILE_NAME characters can have */
+#define CONTEXT_MAX_NAMES (MAX_FILE_NAME / 2)
+
+/* operations the lock statistics are kept for */
+#define OP_LOOKUP 0
+#define OP_CREATE 1
+#define OP_DELETE 2
+#define OP_MOVE 3
+#define OP_FILE 4
+#define OP_COUNT 5
+
+/*
+ * A name of a parsed path, with its length and name_hash, so directory
+ * and cache lookups don't scan it again.
+ */
+typedef struct op_name {
+	char *name;      /* into the path's buffer, null terminated */
+	int len;
+	uint32_t hash;
+} op_name_t;
+
+/*
+ * A path split into its names, which point into a copy of the path where
+ * every slash was replaced by '\0'. parent_length is the length of the
+ * part of the original path up to the end of the next to last name (0 if
+ * there is none), so it prints the parent without trailing slashes.
+ */
+typedef struct op_path {
+	char buffer[MAX_FILE_NAME];
+	op_name_t names[CONTEXT_MAX_NAMES];
+	int count;
+	int parent_length;
+} op_path_t;
+
+typedef struct op_stats {
+	long ops;
+	long taken;      /* locks taken */
+	long contended;  /* locks that had to be waited for */
+	long wait;       /* nanoseconds waited, summed */
+	int held_max;    /* most locks held at once */
+} op_stats_t;
+
+typedef struct op_context {
+	int locked[CONTEXT_MAX_LOCKED];
+	int locked_count;
+	int renaming;    /* holds the rename lock */
+	int op;          /* operation running, one of OP_* */
+	op_path_t paths[2]; /* a move uses both */
+	op_stats_t stats[OP_COUNT];
+	struct op_context *next;
+} op_context_t;
+
+op_context_t *context_get();
+void context_begin(op_context_t *context, int op);
+int context_parse(op_path_t *path, char *name);
+void context_lock(op_context_t *context, int inumber, char rw);
+void context_unlock(op_context_t *context, int inumber);
+void context_unlock_all(op_context_t *context);
+int context_holds(op_context_t *context, int inumber);
+void context_rename_lock(op_context_t *context);
+void context_rename_unlock(op_context_t *context);
+void context_print_stats(FILE *fp);
+
+#endif /* CONTEXT_H */
@@ -0,0 +1,222 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "state.h"
+#include "dcache.h"
+
+dcache_bucket_t *dcache_buckets = NULL;
+
+/*
+ * Returns the bucket of a name in a directory.
+ */
+static dcache_bucket_t *dcache_bucket(int parent, uint32_t hash) {
+    uint32_t key = hash ^ ((uint32_t) parent * 2654435761u);
+
+    return &dcache_buckets[key >> (32 - DCACHE_BUCKET_SHIFT)];
+}
+
+/*
+ * Returns the entry of a bucket holding the given name, or NULL.
+ * Readers call it between two reads of the sequence, writers with the
+ * bucket held.
+ */
+static dcache_entry_t *dcache_match(dcache_bucket_t *bucket, int parent,
+                                    char *name, int len, uint32_t hash) {
+    for (int i = 0; i < DCACHE_WAYS; i++) {
+        dcache_entry_t *entry = &bucket->entries[i];
+
+        if (entry->hash == hash && entry->parent == parent && entry->len == len &&
+            memcmp(entry->name, name, len) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void dcache_write_begin(dcache_bucket_t *bucket) {
+    unsigned int sequence;
+
+    for (;;) {
+        sequence = __atomic_load_n(&bucket->sequence, __ATOMIC_RELAXED);
+
+        if (!(sequence & 1) && __atomic_compare_exchange_n(&bucket->sequence, &sequence,
+              sequence + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+        sched_yield();
+    }
+
+    /* readers must see the odd sequence before any change to the entries */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void dcache_write_end(dcache_bucket_t *bucket) {
+    __atomic_store_n(&bucket->sequence, bucket->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Allocates the cache, empty.
+ */
+void dcache_init() {
+    if ((dcache_buckets = calloc(DCACHE_BUCKET_COUNT, sizeof(dcache_bucket_t))) == NULL) {
+        perror("Error: unable to allocate dentry cache.\n");
+        exit(EXIT_FAILURE);
+    }
+    slab_charge_fixed(DCACHE_BUCKET_COUNT * sizeof(dcache_bucket_t), SLAB_CACHES);
+}
+
+void dcache_destroy() {
+    free(dcache_buckets);
+    slab_uncharge(DCACHE_BUCKET_COUNT * sizeof(dcache_bucket_t), SLAB_CACHES);
+    dcache_buckets = NULL;
+}
+
+/*
+ * Looks a name up in the cache, without locking.
+ * Input:
+ *  - parent: inumber of the directory
+ *  - parent_generation: generation of the directory
+ *  - name: name of the entry
+ *  - len: length of the name
+ *  - hash: name_hash of the name
+ *  - child_generation: pointer to store the generation of the i-node found
+ * Returns: inumber of the i-node, or FAIL if the name isn't cached
+ */
+int dcache_find(int parent, unsigned int parent_generation, char *name, int len,
+                uint32_t hash, unsigned int *child_generation) {
+    dcache_bucket_t *bucket = dcache_bucket(parent, hash);
+    unsigned int sequence;
+    int child;
+
+    if (len > DCACHE_NAME_SIZE)
+        return FAIL;
+
+    do {
+        while ((sequence = __atomic_load_n(&bucket->sequence, __ATOMIC_ACQUIRE)) & 1)
+            sched_yield();
+
+        dcache_entry_t *entry = dcache_match(bucket, parent, name, len, hash);
+
+        child = FAIL;
+        if (entry != NULL && entry->parent_generation == parent_generation) {
+            child = entry->child;
+            *child_generation = entry->child_generation;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&bucket->sequence, __ATOMIC_RELAXED) != sequence);
+
+    return child;
+}
+
+/*
+ * Caches an entry unless changed() says its directory changed, checking it
+ * with the bucket held, see dcache_add and dcache_add_unlocked.
+ */
+static void dcache_insert(int parent, unsigned int parent_generation, char *name,
+                          int len, uint32_t hash, int child, unsigned int child_generation,
+                          int (*changed)(void *), void *arg) {
+    dcache_bucket_t *bucket = dcache_bucket(parent, hash);
+    dcache_entry_t *entry;
+    unsigned int generation;
+
+    /* lookups add every name they walk: don't make the common case write */
+    if (len > DCACHE_NAME_SIZE ||
+        (dcache_find(parent, parent_generation, name, len, hash, &generation) == child &&
+         generation == child_generation))
+        return;
+
+    dcache_write_begin(bucket);
+
+    if (changed != NULL && changed(arg)) {
+        dcache_write_end(bucket);
+        return;
+    }
+
+    if ((entry = dcache_match(bucket, parent, name, len, hash)) == NULL) {
+        for (int i = 0; i < DCACHE_WAYS && entry == NULL; i++) {
+            if (bucket->entries[i].hash == 0)
+                entry = &bucket->entries[i];
+        }
+
+        if (entry == NULL)
+            entry = &bucket->entries[bucket->victim++ % DCACHE_WAYS];
+    }
+
+    entry->hash = hash;
+    entry->parent = parent;
+    entry->parent_generation = parent_generation;
+    entry->child = child;
+    entry->child_generation = child_generation;
+    entry->len = len;
+    memcpy(entry->name, name, len);
+
+    dcache_write_end(bucket);
+}
+
+/*
+ * Caches an entry of a directory, which must be locked and hold it.
+ * Input:
+ *  - parent: inumber of the directory
+ *  - parent_generation: generation of the directory
+ *  - name: name of the entry
+ *  - child: inumber the entry refers to
+ *  - child_generation: generation of that i-node
+ */
+void dcache_add(int parent, unsigned int parent_generation, char *name,
+                int child, unsigned int child_generation) {
+    int len = strlen(name);
+
+    dcache_insert(parent, parent_generation, name, len, name_hash(name, len),
+                  child, child_generation, NULL, NULL);
+}
+
+/*
+ * As dcache_add, given the name's length and hash.
+ */
+void dcache_add_hashed(int parent, unsigned int parent_generation, char *name, int len,
+                       uint32_t hash, int child, unsigned int child_generation) {
+    dcache_insert(parent, parent_generation, name, len, hash, child, child_generation, NULL, NULL);
+}
+
+/*
+ * Caches an entry found in a directory read without locking it, unless
+ * changed() says the directory changed since. It is checked with the
+ * bucket held: a change to the directory moves its sequence before taking
+ * the bucket to drop the name, so either it is seen here or it drops the
+ * entry added.
+ * Input: as for dcache_add, plus
+ *  - len: length of the name
+ *  - hash: name_hash of the name
+ *  - changed: returns nonzero if the directory may have changed, given arg
+ */
+void dcache_add_unlocked(int parent, unsigned int parent_generation, char *name,
+                         int len, uint32_t hash, int child, unsigned int child_generation,
+                         int (*changed)(void *), void *arg) {
+    dcache_insert(parent, parent_generation, name, len, hash, child, child_generation, changed, arg);
+}
+
+/*
+ * Drops a name of a directory from the cache. Must be called with the
+ * directory locked for write, after the name is removed from it.
+ * Input:
+ *  - parent: inumber of the directory
+ *  - name: name of the entry
+ */
+void dcache_remove(int parent, char *name) {
+    int len = strlen(name);
+    uint32_t hash = name_hash(name, len);
+    dcache_bucket_t *bucket = dcache_bucket(parent, hash);
+    dcache_entry_t *entry;
+
+    if (len > DCACHE_NAME_SIZE)
+        return;
+
+    dcache_write_begin(bucket);
+
+    if ((entry = dcache_match(bucket, parent, name, len, hash)) != NULL)
+        entry->hash = 0;
+
+    dcache_write_end(bucket);
+}
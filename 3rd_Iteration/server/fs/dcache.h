@@ -0,0 +1,50 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdint.h>
+
+/*
+ * Dentry cache: maps a (directory, name) pair to the i-node the name
+ * refers to, so paths can be resolved without locking every directory on
+ * the way. Entries are only added and removed with their directory locked,
+ * next to the change to the directory itself, so the cache never holds a
+ * name the directory doesn't have. Directories are identified by inumber
+ * and generation, so entries of a deleted directory can't match the next
+ * i-node given its inumber.
+ *
+ * The table is a fixed array of buckets, allocated zeroed so only the
+ * pages that get used take memory. Each bucket is a small seqlock: a writer
+ * makes the sequence odd while it changes the bucket and readers, which
+ * never write, retry if the sequence moved under them. Names longer than
+ * DCACHE_NAME_SIZE aren't cached.
+ */
+#define DCACHE_BUCKET_SHIFT 16
+#define DCACHE_BUCKET_COUNT (1 << DCACHE_BUCKET_SHIFT)
+#define DCACHE_WAYS 4
+#define DCACHE_NAME_SIZE 32
+
+typedef struct dcache_entry {
+	uint32_t hash;  /* name hash, 0 for a free entry */
+	int parent;
+	unsigned int parent_generation;
+	int child;
+	unsigned int child_generation;
+	unsigned char len;
+	char name[DCACHE_NAME_SIZE];  /* not null terminated */
+} dcache_entry_t;
+
+typedef struct dcache_bucket {
+	unsigned int sequence;  /* odd while a writer changes the bucket */
+	unsigned int victim;    /* next entry replaced when the bucket is full */
+	dcache_entry_t entries[DCACHE_WAYS];
+} __attribute__((aligned(64))) dcache_bucket_t;
+
+void dcache_init();
+void dcache_destroy();
+int dcache_find(int parent, unsigned int parent_generation, char *name, int len, uint32_t hash, unsigned int *child_generation);
+void dcache_add(int parent, unsigned int parent_generation, char *name, int child, unsigned int child_generation);
+void dcache_add_hashed(int parent, unsigned int parent_generation, char *name, int len, uint32_t hash, int child, unsigned int child_generation);
+void dcache_add_unlocked(int parent, unsigned int parent_generation, char *name, int len, uint32_t hash, int child, unsigned int child_generation, int (*changed)(void *), void *arg);
+void dcache_remove(int parent, char *name);
+
+#endif /* DCACHE_H */
@@ -0,0 +1,1228 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "state.h"
+#include "directory.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DIR_SIMD
+#endif
+
+/* initial size of the name heap */
+#define DIR_HEAP_MIN_SIZE 64
+
+/*
+ * Finds the first hash equal to the searched one.
+ * Input:
+ *  - hashes: array to search
+ *  - count: number of hashes in the array
+ *  - hash: the searched hash
+ * Returns: its position, or count if there is none
+ */
+static int hash_scan_scalar(const uint32_t *hashes, int count, uint32_t hash) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (hashes[i] == hash)
+            break;
+    }
+
+    return i;
+}
+
+#ifdef DIR_SIMD
+__attribute__((target("sse2")))
+static int hash_scan_sse2(const uint32_t *hashes, int count, uint32_t hash) {
+    __m128i key = _mm_set1_epi32((int) hash);
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (hashes + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, key)));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + hash_scan_scalar(hashes + i, count - i, hash);
+}
+
+__attribute__((target("avx2")))
+static int hash_scan_avx2(const uint32_t *hashes, int count, uint32_t hash) {
+    __m256i key = _mm256_set1_epi32((int) hash);
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (hashes + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, key)));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + hash_scan_scalar(hashes + i, count - i, hash);
+}
+#endif
+
+/* picked by directory_init for the running CPU */
+static hash_scan_t hash_scan = hash_scan_scalar;
+
+/*
+ * Hashes a name (32-bit FNV-1a).
+ * Input:
+ *  - name: the name, not necessarily null terminated
+ *  - len: length of the name
+ */
+uint32_t name_hash(const char *name, int len) {
+    uint32_t hash = NAME_HASH_INIT;
+
+    for (int i = 0; i < len; i++)
+        hash = NAME_HASH_STEP(hash, name[i]);
+
+    return NAME_HASH_END(hash);
+}
+
+/*
+ * Returns a name scan kernel.
+ * Input:
+ *  - kernel: DIR_SCAN_SCALAR, DIR_SCAN_SSE2 or DIR_SCAN_AVX2
+ * Returns: the kernel, or NULL if the CPU does not support it
+ */
+hash_scan_t directory_scan_kernel(int kernel) {
+    switch (kernel) {
+    case DIR_SCAN_SCALAR:
+        return hash_scan_scalar;
+#ifdef DIR_SIMD
+    case DIR_SCAN_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? hash_scan_sse2 : NULL;
+    case DIR_SCAN_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? hash_scan_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Selects the fastest name scan the CPU supports. Must be called before
+ * any directory is searched.
+ */
+void directory_init() {
+    for (int kernel = DIR_SCAN_AVX2; kernel > DIR_SCAN_SCALAR; kernel--) {
+        hash_scan_t scan = directory_scan_kernel(kernel);
+
+        if (scan != NULL) {
+            hash_scan = scan;
+            return;
+        }
+    }
+}
+
+/*
+ * Compares two names like strcmp.
+ */
+static int name_compare(const char *a, int a_len, const char *b, int b_len) {
+    int result = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+    return result != 0 ? result : a_len - b_len;
+}
+
+/*
+ * Returns the characters of an array entry's name (not null terminated).
+ */
+static const char *entry_name(DirArray *array, DirEntry *entry) {
+
+    if (entry->len <= DIR_INLINE_NAME)
+        return entry->n.name;
+
+    return array->heap + entry->n.offset;
+}
+
+/*
+ * Checks if a slot of an array holds the given name.
+ */
+static int slot_matches(DirArray *array, int slot, const char *name, int len, uint32_t hash) {
+    DirEntry *entry = &array->entries[slot];
+
+    return array->hashes[slot] == hash && entry->len == len &&
+      memcmp(entry_name(array, entry), name, len) == 0;
+}
+
+/*
+ * Moves the live long names to a heap with room for at least len more bytes.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int heap_grow(DirArray *array, int len) {
+    int live = array->heap_used - array->heap_garbage;
+    int size = array->heap_size > 0 ? array->heap_size : DIR_HEAP_MIN_SIZE;
+    DirArray old = *array;
+    char *heap;
+
+    while (size < live + len)
+        size *= 2;
+
+    if ((heap = slab_alloc(size, SLAB_NAMES)) == NULL)
+        return FAIL;
+
+    array->heap_used = 0;
+    for (int i = 0; i < array->used; i++) {
+        DirEntry *entry = &array->entries[i];
+
+        if (entry->inumber == FREE_INODE || entry->len <= DIR_INLINE_NAME)
+            continue;
+
+        memcpy(heap + array->heap_used, array->heap + entry->n.offset, entry->len);
+        entry->n.offset = array->heap_used;
+        array->heap_used += entry->len;
+    }
+
+    array->heap = heap;
+    array->heap_size = size;
+    array->heap_garbage = 0;
+    epoch_retire(old.heap, old.heap_size, SLAB_NAMES);
+
+    return SUCCESS;
+}
+
+/*
+ * Looks for the slot of a name. The hashes are scanned and only the slots
+ * whose hash matches have their name compared.
+ * Returns: the slot, or FAIL if not found
+ */
+static int array_find(DirArray *array, const char *name, int len, uint32_t hash) {
+
+    for (int i = 0; ; i++) {
+        i += hash_scan(array->hashes + i, array->used - i, hash);
+
+        if (i >= array->used)
+            return FAIL;
+
+        if (slot_matches(array, i, name, len, hash))
+            return i;
+    }
+}
+
+/*
+ * Doubles the entry array of a directory with no free slots.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int array_grow(DirArray *array) {
+    int capacity = array->capacity * 2;
+    DirEntry *entries = slab_alloc(capacity * sizeof(DirEntry), SLAB_DIRECTORIES);
+    uint32_t *hashes = slab_alloc(capacity * sizeof(uint32_t), SLAB_DIRECTORIES);
+    DirArray old = *array;
+
+    if (entries == NULL || hashes == NULL) {
+        slab_free(entries, capacity * sizeof(DirEntry), SLAB_DIRECTORIES);
+        slab_free(hashes, capacity * sizeof(uint32_t), SLAB_DIRECTORIES);
+        return FAIL;
+    }
+
+    memcpy(entries, array->entries, array->used * sizeof(DirEntry));
+    memcpy(hashes, array->hashes, array->used * sizeof(uint32_t));
+    array->entries = entries;
+    array->hashes = hashes;
+    array->capacity = capacity;
+    epoch_retire(old.entries, old.capacity * sizeof(DirEntry), SLAB_DIRECTORIES);
+    epoch_retire(old.hashes, old.capacity * sizeof(uint32_t), SLAB_DIRECTORIES);
+
+    return SUCCESS;
+}
+
+/*
+ * Allocates the blocks of an empty array.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int array_create(DirArray *array) {
+    array->entries = slab_alloc(DIR_ARRAY_INITIAL * sizeof(DirEntry), SLAB_DIRECTORIES);
+    array->hashes = slab_alloc(DIR_ARRAY_INITIAL * sizeof(uint32_t), SLAB_DIRECTORIES);
+
+    if (array->entries == NULL || array->hashes == NULL) {
+        slab_free(array->entries, DIR_ARRAY_INITIAL * sizeof(DirEntry), SLAB_DIRECTORIES);
+        slab_free(array->hashes, DIR_ARRAY_INITIAL * sizeof(uint32_t), SLAB_DIRECTORIES);
+        return FAIL;
+    }
+
+    array->heap = NULL;
+    array->capacity = DIR_ARRAY_INITIAL;
+    array->used = 0;
+    array->free_slot = FREE_INODE;
+    array->heap_size = 0;
+    array->heap_used = 0;
+    array->heap_garbage = 0;
+
+    return SUCCESS;
+}
+
+/*
+ * Releases the blocks of an array.
+ */
+static void array_destroy(DirArray *array) {
+    epoch_retire(array->heap, array->heap_size, SLAB_NAMES);
+    epoch_retire(array->entries, array->capacity * sizeof(DirEntry), SLAB_DIRECTORIES);
+    epoch_retire(array->hashes, array->capacity * sizeof(uint32_t), SLAB_DIRECTORIES);
+}
+
+/*
+ * Adds an entry to an array in the most recently freed slot, or after the
+ * last used slot if there is none, growing the array if needed.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int array_add(DirArray *array, int inumber, const char *name, int len) {
+    DirEntry *entry;
+    int slot;
+
+    /* the heap may move, so make room before taking a free slot out of the list */
+    if (len > DIR_INLINE_NAME && array->heap_used + len > array->heap_size &&
+      heap_grow(array, len) == FAIL)
+        return FAIL;
+
+    if (array->free_slot != FREE_INODE) {
+        slot = array->free_slot;
+        array->free_slot = (int) array->entries[slot].n.offset;
+    }
+    else {
+        if (array->used == array->capacity && array_grow(array) == FAIL)
+            return FAIL;
+
+        slot = array->used++;
+    }
+
+    entry = &array->entries[slot];
+
+    if (len <= DIR_INLINE_NAME) {
+        memcpy(entry->n.name, name, len);
+    }
+    else {
+        memcpy(array->heap + array->heap_used, name, len);
+        entry->n.offset = array->heap_used;
+        array->heap_used += len;
+    }
+
+    array->hashes[slot] = name_hash(name, len);
+    entry->len = len;
+    entry->inumber = inumber;
+
+    return SUCCESS;
+}
+
+/*
+ * Frees a slot of an array.
+ */
+static void array_remove(DirArray *array, int slot) {
+    DirEntry *entry = &array->entries[slot];
+
+    if (entry->len > DIR_INLINE_NAME)
+        array->heap_garbage += entry->len;
+
+    entry->inumber = FREE_INODE;
+    array->hashes[slot] = 0;
+    entry->n.offset = (uint32_t) array->free_slot;
+    array->free_slot = slot;
+}
+
+/*
+ * Copies a name into a new null terminated tree key.
+ * Returns: the key, or NULL if out of memory
+ */
+static char *key_create(const char *name, int len) {
+    char *key = slab_alloc(len + 1, SLAB_NAMES);
+
+    if (key == NULL)
+        return NULL;
+
+    memcpy(key, name, len);
+    key[len] = '\0';
+
+    return key;
+}
+
+static void key_destroy(char *key) {
+    epoch_retire(key, strlen(key) + 1, SLAB_NAMES);
+}
+
+/*
+ * Allocates an empty tree node.
+ * Returns: the node, or NULL if out of memory
+ */
+static DirNode *node_create(int leaf) {
+    DirNode *node = slab_alloc(sizeof(DirNode), SLAB_DIRECTORIES);
+
+    if (node == NULL)
+        return NULL;
+
+    node->leaf = leaf;
+    node->count = 0;
+
+    return node;
+}
+
+/*
+ * Releases a subtree, keys included.
+ */
+static void node_destroy(DirNode *node) {
+
+    for (int i = 0; i < node->count; i++)
+        key_destroy(node->keys[i]);
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++)
+            node_destroy(node->u.children[i]);
+    }
+
+    epoch_retire(node, sizeof(DirNode), SLAB_DIRECTORIES);
+}
+
+/*
+ * Binary searches the keys of a node.
+ * Input:
+ *  - strict: whether to look for the first key greater than the name,
+ *    rather than greater or equal
+ * Returns: the position of the first such key, or count if there is none
+ */
+static int node_position(DirNode *node, const char *name, int strict) {
+    int low = 0, high = node->count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        int result = strcmp(node->keys[middle], name);
+
+        if (result < 0 || (strict && result == 0))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/*
+ * Returns the leaf whose range holds a name.
+ */
+static DirNode *tree_leaf(DirNode *root, const char *name) {
+    DirNode *node = root;
+
+    while (!node->leaf)
+        node = node->u.children[node_position(node, name, 1)];
+
+    return node;
+}
+
+/*
+ * Puts a key in a leaf with room for it.
+ */
+static void leaf_put(DirNode *node, int position, char *key, int inumber) {
+    int moved = node->count - position;
+
+    memmove(&node->keys[position + 1], &node->keys[position], moved * sizeof(char *));
+    memmove(&node->u.inumbers[position + 1], &node->u.inumbers[position], moved * sizeof(int));
+    node->keys[position] = key;
+    node->u.inumbers[position] = inumber;
+    node->count++;
+}
+
+/*
+ * Puts a key and the child to its right in an inner node with room for them.
+ */
+static void inner_put(DirNode *node, int position, char *key, DirNode *child) {
+    int moved = node->count - position;
+
+    memmove(&node->keys[position + 1], &node->keys[position], moved * sizeof(char *));
+    memmove(&node->u.children[position + 2], &node->u.children[position + 1],
+      moved * sizeof(DirNode *));
+    node->keys[position] = key;
+    node->u.children[position + 1] = child;
+    node->count++;
+}
+
+/*
+ * Inserts a key in the subtree of a node. A full node is split: its upper
+ * half moves to a new node, returned in split, and separator gets the key
+ * that bounds the new node from below. Every allocation is made before the
+ * tree is changed, so a failure leaves it as it was.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int node_insert(DirNode *node, char *key, int inumber, char **separator, DirNode **split) {
+    int middle = DIR_TREE_ORDER / 2, position;
+    DirNode *right;
+
+    *split = NULL;
+
+    if (node->leaf) {
+        position = node_position(node, key, 0);
+
+        if (node->count < DIR_TREE_ORDER) {
+            leaf_put(node, position, key, inumber);
+            return SUCCESS;
+        }
+
+        /* the smallest key of the new leaf is either the new key or the middle one */
+        right = node_create(1);
+        *separator = position == middle ? key : node->keys[middle];
+        if (right == NULL || (*separator = key_create(*separator, strlen(*separator))) == NULL) {
+            slab_free(right, sizeof(DirNode), SLAB_DIRECTORIES);
+            return FAIL;
+        }
+
+        right->count = DIR_TREE_ORDER - middle;
+        memcpy(right->keys, &node->keys[middle], right->count * sizeof(char *));
+        memcpy(right->u.inumbers, &node->u.inumbers[middle], right->count * sizeof(int));
+        node->count = middle;
+
+        if (position < middle)
+            leaf_put(node, position, key, inumber);
+        else
+            leaf_put(right, position - middle, key, inumber);
+    }
+    else {
+        char *child_separator;
+        DirNode *child_split;
+
+        position = node_position(node, key, 1);
+
+        right = NULL;
+        if (node->count == DIR_TREE_ORDER && (right = node_create(0)) == NULL)
+            return FAIL;
+
+        if (node_insert(node->u.children[position], key, inumber, &child_separator, &child_split) == FAIL) {
+            slab_free(right, sizeof(DirNode), SLAB_DIRECTORIES);
+            return FAIL;
+        }
+
+        if (child_split == NULL) {
+            slab_free(right, sizeof(DirNode), SLAB_DIRECTORIES);
+            return SUCCESS;
+        }
+
+        if (node->count < DIR_TREE_ORDER) {
+            inner_put(node, position, child_separator, child_split);
+            return SUCCESS;
+        }
+
+        /* the middle key moves up to the parent */
+        *separator = node->keys[middle];
+        right->count = DIR_TREE_ORDER - middle - 1;
+        memcpy(right->keys, &node->keys[middle + 1], right->count * sizeof(char *));
+        memcpy(right->u.children, &node->u.children[middle + 1], (right->count + 1) * sizeof(DirNode *));
+        node->count = middle;
+
+        if (position <= middle)
+            inner_put(node, position, child_separator, child_split);
+        else
+            inner_put(right, position - middle - 1, child_separator, child_split);
+    }
+
+    *split = right;
+    return SUCCESS;
+}
+
+/*
+ * Adds an entry to the tree of a directory.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int tree_add(Directory *dir, int inumber, const char *name, int len) {
+    DirNode *root = dir->u.tree.root, *new_root = NULL, *split;
+    char *key, *separator;
+
+    if ((key = key_create(name, len)) == NULL)
+        return FAIL;
+
+    /* only a full root can split */
+    if (root->count == DIR_TREE_ORDER && (new_root = node_create(0)) == NULL) {
+        key_destroy(key);
+        return FAIL;
+    }
+
+    if (node_insert(root, key, inumber, &separator, &split) == FAIL) {
+        key_destroy(key);
+        slab_free(new_root, sizeof(DirNode), SLAB_DIRECTORIES);
+        return FAIL;
+    }
+
+    if (split != NULL) {
+        new_root->count = 1;
+        new_root->keys[0] = separator;
+        new_root->u.children[0] = root;
+        new_root->u.children[1] = split;
+        dir->u.tree.root = new_root;
+    }
+    else {
+        slab_free(new_root, sizeof(DirNode), SLAB_DIRECTORIES);
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * Removes a name from the subtree of a node, releasing the nodes that
+ * become empty.
+ * Input:
+ *  - inumber: inumber the entry must refer to
+ *  - empty: set when the node is left without entries
+ * Returns: SUCCESS or FAIL if there is no such entry
+ */
+static int node_remove(DirNode *node, const char *name, int inumber, int *empty) {
+    int position;
+
+    *empty = 0;
+
+    if (node->leaf) {
+        position = node_position(node, name, 0);
+
+        if (position == node->count || strcmp(node->keys[position], name) != 0 ||
+          node->u.inumbers[position] != inumber)
+            return FAIL;
+
+        key_destroy(node->keys[position]);
+        node->count--;
+        memmove(&node->keys[position], &node->keys[position + 1],
+          (node->count - position) * sizeof(char *));
+        memmove(&node->u.inumbers[position], &node->u.inumbers[position + 1],
+          (node->count - position) * sizeof(int));
+    }
+    else {
+        int child_empty, key;
+
+        position = node_position(node, name, 1);
+
+        if (node_remove(node->u.children[position], name, inumber, &child_empty) == FAIL)
+            return FAIL;
+
+        if (!child_empty)
+            return SUCCESS;
+
+        epoch_retire(node->u.children[position], sizeof(DirNode), SLAB_DIRECTORIES);
+
+        if (node->count == 0) {
+            /* that was the only child */
+            *empty = 1;
+            return SUCCESS;
+        }
+
+        /* the range of the removed child joins the one of a neighbour */
+        key = position > 0 ? position - 1 : 0;
+        key_destroy(node->keys[key]);
+        node->count--;
+        memmove(&node->keys[key], &node->keys[key + 1], (node->count - key) * sizeof(char *));
+        memmove(&node->u.children[position], &node->u.children[position + 1],
+          (node->count + 1 - position) * sizeof(DirNode *));
+    }
+
+    *empty = node->count == 0 && node->leaf;
+    return SUCCESS;
+}
+
+/*
+ * Removes an entry from the tree of a directory.
+ * Returns: SUCCESS or FAIL if there is no such entry
+ */
+static int tree_remove(Directory *dir, const char *name, int inumber) {
+    DirNode *root = dir->u.tree.root;
+    int empty;
+
+    if (node_remove(root, name, inumber, &empty) == FAIL)
+        return FAIL;
+
+    if (empty && !root->leaf) {
+        /* every child is gone, the root becomes an empty leaf */
+        root->leaf = 1;
+        root->count = 0;
+    }
+
+    while (!root->leaf && root->count == 0) {
+        DirNode *child = root->u.children[0];
+
+        epoch_retire(root, sizeof(DirNode), SLAB_DIRECTORIES);
+        root = child;
+    }
+
+    dir->u.tree.root = root;
+    return SUCCESS;
+}
+
+/*
+ * Finds the first key of a tree greater than a name.
+ * Returns: the leaf holding the key and its position in index, or NULL
+ */
+static DirNode *tree_next(DirNode *root, const char *name, int *index) {
+    DirNode *node = root, *next = NULL;
+    int position;
+
+    while (!node->leaf) {
+        position = node_position(node, name, 1);
+
+        /* the subtree to the right is where to continue if this one has no such key */
+        if (position < node->count)
+            next = node->u.children[position + 1];
+        node = node->u.children[position];
+    }
+
+    position = node_position(node, name, 1);
+
+    if (position == node->count) {
+        if (next == NULL)
+            return NULL;
+
+        for (node = next; !node->leaf; node = node->u.children[0])
+            ;
+        position = 0;
+    }
+
+    *index = position;
+    return node;
+}
+
+/*
+ * Returns the bits a name sets in its word of a filter, the word's index
+ * being put in word. The name hash is spread over 64 bits and the three
+ * top 6-bit fields pick the bits, the bits from 28 up the word. Low bits
+ * of the product only depend on low bits of the hash, so none are used.
+ */
+static uint64_t filter_bits(DirTree *tree, uint32_t hash, int *word) {
+    uint64_t mix = (uint64_t) hash * 0x9e3779b97f4a7c15ull;
+
+    *word = (int) (mix >> 28) & (tree->filter_words - 1);
+
+    return (1ull << (mix >> 58)) | (1ull << ((mix >> 52) & 63)) | (1ull << ((mix >> 46) & 63));
+}
+
+static void filter_set(DirTree *tree, const char *name, int len) {
+    int word;
+    uint64_t bits = filter_bits(tree, name_hash(name, len), &word);
+
+    tree->filter[word] |= bits;
+    tree->filter_names++;
+}
+
+/*
+ * Sets the names of a subtree in the filter.
+ */
+static void filter_set_node(DirTree *tree, DirNode *node) {
+
+    for (int i = 0; i < node->count + !node->leaf; i++) {
+        if (node->leaf)
+            filter_set(tree, node->keys[i], strlen(node->keys[i]));
+        else
+            filter_set_node(tree, node->u.children[i]);
+    }
+}
+
+static void filter_destroy(DirTree *tree) {
+    epoch_retire(tree->filter, tree->filter_words * sizeof(uint64_t), SLAB_DIRECTORIES);
+    tree->filter = NULL;
+    tree->filter_words = 0;
+    tree->filter_names = 0;
+}
+
+/*
+ * Replaces the filter of a tree by one sized for its current names. If out
+ * of memory the old filter is kept, since it still holds every name.
+ * Input:
+ *  - count: number of names in the tree
+ */
+static void filter_build(DirTree *tree, int count) {
+    DirTree built = *tree, old = *tree;
+
+    built.filter_words = 1;
+    while (built.filter_words * 64 < count * DIR_FILTER_BITS)
+        built.filter_words *= 2;
+
+    if ((built.filter = slab_alloc(built.filter_words * sizeof(uint64_t), SLAB_DIRECTORIES)) == NULL)
+        return;
+
+    memset(built.filter, 0, built.filter_words * sizeof(uint64_t));
+    built.filter_names = 0;
+    filter_set_node(&built, built.root);
+
+    *tree = built;
+    filter_destroy(&old);
+}
+
+/*
+ * Checks the filter of a tree for a name.
+ * Returns: 0 if the name is surely not in the tree, 1 if it may be
+ */
+static int filter_may_hold(DirTree *tree, uint32_t hash) {
+    int word;
+    uint64_t bits;
+
+    if (tree->filter == NULL)
+        return 1;
+
+    bits = filter_bits(tree, hash, &word);
+    return (tree->filter[word] & bits) == bits;
+}
+
+/*
+ * Looks for a name among the inline entries.
+ * Returns: its position, or FAIL if not found
+ */
+static int inline_find(Directory *dir, const char *name, int len) {
+
+    for (int i = 0; i < DIR_INLINE_ENTRIES; i++) {
+        DirEntry *entry = &dir->u.entries[i];
+
+        if (entry->inumber != FREE_INODE && entry->len == len && memcmp(entry->n.name, name, len) == 0)
+            return i;
+    }
+
+    return FAIL;
+}
+
+/*
+ * Moves the entries of an inline or tree directory to an array.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int to_array(Directory *dir) {
+    DirArray array;
+
+    if (array_create(&array) == FAIL)
+        return FAIL;
+
+    if (dir->kind == DIR_INLINE) {
+        for (int i = 0; i < DIR_INLINE_ENTRIES; i++) {
+            DirEntry *entry = &dir->u.entries[i];
+
+            if (entry->inumber != FREE_INODE &&
+              array_add(&array, entry->inumber, entry->n.name, entry->len) == FAIL) {
+                array_destroy(&array);
+                return FAIL;
+            }
+        }
+    }
+    else {
+        char name[MAX_FILE_NAME] = "";
+        DirNode *node;
+        int index;
+
+        while ((node = tree_next(dir->u.tree.root, name, &index)) != NULL) {
+            strcpy(name, node->keys[index]);
+
+            if (array_add(&array, node->u.inumbers[index], name, strlen(name)) == FAIL) {
+                array_destroy(&array);
+                return FAIL;
+            }
+        }
+
+        node_destroy(dir->u.tree.root);
+        filter_destroy(&dir->u.tree);
+    }
+
+    dir->kind = DIR_ARRAY;
+    dir->u.array = array;
+
+    return SUCCESS;
+}
+
+/*
+ * Moves the entries of an array directory to a tree.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int to_tree(Directory *dir) {
+    Directory tree;
+
+    if ((tree.u.tree.root = node_create(1)) == NULL)
+        return FAIL;
+
+    for (int i = 0; i < dir->u.array.used; i++) {
+        DirEntry *entry = &dir->u.array.entries[i];
+
+        if (entry->inumber != FREE_INODE &&
+          tree_add(&tree, entry->inumber, entry_name(&dir->u.array, entry), entry->len) == FAIL) {
+            node_destroy(tree.u.tree.root);
+            return FAIL;
+        }
+    }
+
+    array_destroy(&dir->u.array);
+    dir->kind = DIR_TREE;
+    dir->u.tree.root = tree.u.tree.root;
+    dir->u.tree.filter = NULL;
+    dir->u.tree.filter_words = 0;
+    dir->u.tree.filter_names = 0;
+    filter_build(&dir->u.tree, dir->count);
+
+    return SUCCESS;
+}
+
+/*
+ * Moves the entries of an array directory inline, if they all fit.
+ */
+static void to_inline(Directory *dir) {
+    DirArray array = dir->u.array;
+    int position = 0;
+
+    for (int i = 0; i < array.used; i++) {
+        if (array.entries[i].inumber != FREE_INODE && array.entries[i].len > DIR_INLINE_NAME)
+            return;
+    }
+
+    for (int i = 0; i < DIR_INLINE_ENTRIES; i++)
+        dir->u.entries[i].inumber = FREE_INODE;
+
+    for (int i = 0; i < array.used; i++) {
+        if (array.entries[i].inumber != FREE_INODE)
+            dir->u.entries[position++] = array.entries[i];
+    }
+
+    array_destroy(&array);
+    dir->kind = DIR_INLINE;
+}
+
+/*
+ * Initializes an empty directory, which takes no memory besides itself.
+ */
+void directory_create(Directory *dir) {
+    dir->kind = DIR_INLINE;
+    dir->count = 0;
+
+    for (int i = 0; i < DIR_INLINE_ENTRIES; i++)
+        dir->u.entries[i].inumber = FREE_INODE;
+}
+
+/*
+ * Releases the memory of a directory, leaving it empty.
+ */
+void directory_destroy(Directory *dir) {
+
+    if (dir->kind == DIR_ARRAY)
+        array_destroy(&dir->u.array);
+    else if (dir->kind == DIR_TREE) {
+        node_destroy(dir->u.tree.root);
+        filter_destroy(&dir->u.tree);
+    }
+
+    directory_create(dir);
+}
+
+/*
+ * Looks for an entry by name.
+ * Returns:
+ *  - inumber: the entry's inumber
+ *  - FAIL: if not found
+ */
+int directory_find(Directory *dir, char *name) {
+    int len = strlen(name);
+
+    return directory_find_hashed(dir, name, len, name_hash(name, len));
+}
+
+/*
+ * Looks for an entry by name, given the name's length and hash, as a
+ * parsed path has them (see context_parse).
+ * Input:
+ *  - name: name of the entry, null terminated
+ *  - len: length of the name
+ *  - hash: name_hash of the name
+ * Returns: as directory_find
+ */
+int directory_find_hashed(Directory *dir, char *name, int len, uint32_t hash) {
+    int position;
+    DirNode *node;
+
+    switch (dir->kind) {
+        case DIR_INLINE:
+            position = inline_find(dir, name, len);
+            return position == FAIL ? FAIL : dir->u.entries[position].inumber;
+
+        case DIR_ARRAY:
+            position = array_find(&dir->u.array, name, len, hash);
+            return position == FAIL ? FAIL : dir->u.array.entries[position].inumber;
+
+        default:
+            if (!filter_may_hold(&dir->u.tree, hash))
+                return FAIL;
+
+            node = tree_leaf(dir->u.tree.root, name);
+            position = node_position(node, name, 0);
+
+            if (position == node->count || strcmp(node->keys[position], name) != 0)
+                return FAIL;
+            return node->u.inumbers[position];
+    }
+}
+
+/*
+ * Looks for a name among the slots of an array read without locking, see
+ * directory_find_unlocked.
+ */
+static int array_find_unlocked(DirArray *array, const char *name, int len, uint32_t hash) {
+    int used = array->used < array->capacity ? array->used : array->capacity;
+
+    for (int i = 0; ; i++) {
+        DirEntry entry;
+
+        i += hash_scan(array->hashes + i, used - i, hash);
+
+        if (i >= used)
+            return FAIL;
+
+        entry = array->entries[i];
+        if (entry.inumber == FREE_INODE || entry.len != len)
+            continue;
+
+        if (len <= DIR_INLINE_NAME) {
+            if (memcmp(entry.n.name, name, len) == 0)
+                return entry.inumber;
+        }
+        else if (array->heap != NULL && len <= array->heap_size &&
+                 entry.n.offset <= (uint32_t) (array->heap_size - len) &&
+                 memcmp(array->heap + entry.n.offset, name, len) == 0) {
+            return entry.inumber;
+        }
+    }
+}
+
+/*
+ * Looks for a name in a tree read without locking, see
+ * directory_find_unlocked. Each node is copied, and its keys and children
+ * are only followed once changed() says the copy is sound.
+ */
+static int tree_find_unlocked(DirTree *tree, const char *name, uint32_t hash,
+                              int (*changed)(void *), void *arg) {
+    DirNode *next = tree->root, node;
+    int position;
+
+    if (!filter_may_hold(tree, hash))
+        return FAIL;
+
+    for (;;) {
+        memcpy(&node, next, sizeof(DirNode));
+
+        if (changed(arg) || node.count < 0 || node.count > DIR_TREE_ORDER)
+            return FAIL;
+
+        position = node_position(&node, name, !node.leaf);
+
+        if (node.leaf) {
+            if (position == node.count || strcmp(node.keys[position], name) != 0)
+                return FAIL;
+            return node.u.inumbers[position];
+        }
+
+        next = node.u.children[position];
+    }
+}
+
+/*
+ * Looks for an entry by name without the directory being locked, while a
+ * writer may be changing it. The caller must be inside an epoch read
+ * section, so no block reached is freed meanwhile, but what is read may be
+ * a mix of states: block pointers are only followed after changed() says
+ * the directory is still as it was when the caller began reading it, and
+ * positions are bounded by the block they index. The result is only right
+ * if changed() still says so afterwards.
+ * Input:
+ *  - name: name of the entry, null terminated
+ *  - len: length of the name
+ *  - hash: name_hash of the name
+ *  - changed: returns nonzero if the directory may have changed, given arg
+ * Returns:
+ *  - inumber: the entry's inumber
+ *  - FAIL: if not found, or if the directory changed
+ */
+int directory_find_unlocked(Directory *dir, char *name, int len, uint32_t hash,
+                            int (*changed)(void *), void *arg) {
+    Directory copy;
+
+    memcpy(&copy, dir, sizeof(Directory));
+
+    if (changed(arg) || len >= MAX_FILE_NAME)
+        return FAIL;
+
+    switch (copy.kind) {
+        case DIR_INLINE:
+            if (len > DIR_INLINE_NAME)
+                return FAIL;
+
+            for (int i = 0; i < DIR_INLINE_ENTRIES; i++) {
+                DirEntry *entry = &copy.u.entries[i];
+
+                if (entry->inumber != FREE_INODE && entry->len == len && memcmp(entry->n.name, name, len) == 0)
+                    return entry->inumber;
+            }
+            return FAIL;
+
+        case DIR_ARRAY:
+            return array_find_unlocked(&copy.u.array, name, len, hash);
+
+        case DIR_TREE:
+            return tree_find_unlocked(&copy.u.tree, name, hash, changed, arg);
+
+        default:
+            return FAIL;
+    }
+}
+
+/*
+ * Adds an entry, moving the directory to a bigger representation if needed.
+ * The name must not be in the directory yet.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+int directory_add(Directory *dir, int inumber, char *name) {
+    int len = strlen(name), result;
+
+    if (len >= MAX_FILE_NAME)
+        return FAIL;
+
+    if (dir->kind == DIR_INLINE) {
+        if (dir->count < DIR_INLINE_ENTRIES && len <= DIR_INLINE_NAME) {
+            DirEntry *entry = &dir->u.entries[0];
+
+            while (entry->inumber != FREE_INODE)
+                entry++;
+
+            memcpy(entry->n.name, name, len);
+            entry->len = len;
+            entry->inumber = inumber;
+
+            dir->count++;
+            return SUCCESS;
+        }
+
+        if (to_array(dir) == FAIL)
+            return FAIL;
+    }
+
+    if (dir->kind == DIR_ARRAY && dir->count == DIR_TREE_THRESHOLD && to_tree(dir) == FAIL)
+        return FAIL;
+
+    if (dir->kind == DIR_ARRAY)
+        result = array_add(&dir->u.array, inumber, name, len);
+    else
+        result = tree_add(dir, inumber, name, len);
+
+    if (result == FAIL)
+        return FAIL;
+
+    dir->count++;
+
+    if (dir->kind == DIR_TREE && dir->u.tree.filter != NULL) {
+        filter_set(&dir->u.tree, name, len);
+
+        if (dir->u.tree.filter_words * 64 < dir->u.tree.filter_names * DIR_FILTER_MIN_BITS)
+            filter_build(&dir->u.tree, dir->count);
+    }
+    else if (dir->kind == DIR_TREE)
+        /* the filter couldn't be allocated before: try again, the name is in the tree */
+        filter_build(&dir->u.tree, dir->count);
+
+    return SUCCESS;
+}
+
+/*
+ * Removes an entry, moving the directory to a smaller representation when
+ * it has shrunk enough.
+ * Input:
+ *  - inumber: inumber the entry must refer to
+ *  - name: name of the entry
+ * Returns: SUCCESS or FAIL if there is no such entry
+ */
+int directory_remove(Directory *dir, int inumber, char *name) {
+    int len = strlen(name), position;
+
+    switch (dir->kind) {
+        case DIR_INLINE:
+            position = inline_find(dir, name, len);
+            if (position == FAIL || dir->u.entries[position].inumber != inumber)
+                return FAIL;
+
+            dir->u.entries[position].inumber = FREE_INODE;
+            dir->count--;
+            break;
+
+        case DIR_ARRAY:
+            position = array_find(&dir->u.array, name, len, name_hash(name, len));
+            if (position == FAIL || dir->u.array.entries[position].inumber != inumber)
+                return FAIL;
+
+            array_remove(&dir->u.array, position);
+            if (--dir->count <= DIR_INLINE_SHRINK)
+                to_inline(dir);
+            break;
+
+        default:
+            if (tree_remove(dir, name, inumber) == FAIL)
+                return FAIL;
+
+            /* if out of memory, it just stays a tree */
+            if (--dir->count <= DIR_TREE_THRESHOLD / 2)
+                to_array(dir);
+            else if (dir->u.tree.filter_names > 2 * dir->count)
+                filter_build(&dir->u.tree, dir->count);
+            break;
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * Checks if a directory has no entries.
+ * Returns: SUCCESS if empty, FAIL otherwise
+ */
+int directory_is_empty(Directory *dir) {
+    return dir->count == 0 ? SUCCESS : FAIL;
+}
+
+/*
+ * Iterates over the entries of a directory in name order. Starting from a
+ * given name lists the names after it, so prefixes and ranges can be listed
+ * without going through the whole directory.
+ * Input:
+ *  - name: buffer of MAX_FILE_NAME characters holding the previous name, or
+ *    an empty string to start; it is replaced by the name of the entry found
+ * Returns:
+ *  - inumber: of the entry following name
+ *  - FREE_INODE: when there are no more entries
+ */
+int directory_next(Directory *dir, char *name) {
+    int len = strlen(name), best = FREE_INODE, best_len = 0;
+    const char *best_name = NULL;
+    DirEntry *entries;
+    int size, index;
+    DirNode *node;
+
+    if (dir->kind == DIR_TREE) {
+        if ((node = tree_next(dir->u.tree.root, name, &index)) == NULL)
+            return FREE_INODE;
+
+        strcpy(name, node->keys[index]);
+        return node->u.inumbers[index];
+    }
+
+    /* small directories are scanned for the smallest name after the given one */
+    if (dir->kind == DIR_INLINE) {
+        entries = dir->u.entries;
+        size = DIR_INLINE_ENTRIES;
+    }
+    else {
+        entries = dir->u.array.entries;
+        size = dir->u.array.used;
+    }
+
+    for (int i = 0; i < size; i++) {
+        const char *entry;
+
+        if (entries[i].inumber == FREE_INODE)
+            continue;
+
+        entry = dir->kind == DIR_INLINE ? entries[i].n.name : entry_name(&dir->u.array, &entries[i]);
+
+        if (name_compare(entry, entries[i].len, name, len) > 0 &&
+          (best_name == NULL || name_compare(entry, entries[i].len, best_name, best_len) < 0)) {
+            best = entries[i].inumber;
+            best_name = entry;
+            best_len = entries[i].len;
+        }
+    }
+
+    if (best_name != NULL) {
+        memcpy(name, best_name, best_len);
+        name[best_len] = '\0';
+    }
+
+    return best;
+}
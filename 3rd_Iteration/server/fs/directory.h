@@ -0,0 +1,158 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <stdint.h>
+#include "../tecnicofs-api-constants.h"
+
+/*
+ * A directory changes representation as it grows and shrinks:
+ *  - DIR_INLINE: up to DIR_INLINE_ENTRIES short names kept inside the
+ *    directory itself, which lives in the i-node, so no memory is allocated;
+ *  - DIR_ARRAY: a small array of entries searched linearly (vectorized on
+ *    the name hashes), with long names in a heap;
+ *  - DIR_TREE: a B+ tree keyed by name for big directories, with a Bloom
+ *    filter of its names so lookups of missing names rarely walk the tree.
+ * Arrays become trees past DIR_TREE_THRESHOLD entries and trees go back to
+ * arrays at half of it; arrays go back inline when at most DIR_INLINE_SHRINK
+ * entries, all with short names, are left.
+ */
+#define DIR_INLINE 0
+#define DIR_ARRAY 1
+#define DIR_TREE 2
+
+#define DIR_INLINE_ENTRIES 3
+#define DIR_INLINE_SHRINK 1
+
+/* slots of a new array directory; the array doubles when it fills up */
+#define DIR_ARRAY_INITIAL 8
+
+#define DIR_TREE_THRESHOLD 64
+
+/* maximum number of keys in a tree node */
+#define DIR_TREE_ORDER 30
+
+/*
+ * Bits of a tree's filter per name when it is built, and the fewest per
+ * name it may be left with before being rebuilt bigger.
+ */
+#define DIR_FILTER_BITS 16
+#define DIR_FILTER_MIN_BITS 8
+
+/* names up to this length are kept inside the entry itself */
+#define DIR_INLINE_NAME 11
+
+/*
+ * Contains the name of the entry and respective i-number.
+ * Short names are stored inline (not null terminated when they fill the
+ * whole field); longer ones live in the name heap of the directory.
+ */
+typedef struct dirEntry {
+	int inumber;
+	unsigned char len;
+	union {
+		char name[DIR_INLINE_NAME];
+		uint32_t offset;
+	} __attribute__((packed)) n; /* packed: keeps the entry at 16 bytes */
+} DirEntry;
+
+/*
+ * Entries of an array directory plus the heap holding its long names.
+ * hashes[slot] is the name hash of each entry, kept apart from the entries
+ * so they can be searched with vector compares; 0 marks a free slot
+ * (name_hash never returns it). Slots [0, used) have been handed out; the
+ * free ones among them are linked through n.offset starting at free_slot
+ * (FREE_INODE ends the list) and are reused before the array grows.
+ * heap_garbage counts heap bytes of removed names, reclaimed when the heap
+ * has to grow.
+ */
+typedef struct dirArray {
+	DirEntry *entries;
+	uint32_t *hashes;
+	char *heap;
+	int capacity;
+	int used;
+	int free_slot;
+	int heap_size;
+	int heap_used;
+	int heap_garbage;
+} DirArray;
+
+/*
+ * B+ tree node. Keys are null terminated names allocated from the slab.
+ * Leaves hold the entries; an inner node with count keys has count + 1
+ * children, child i holding the names in [keys[i - 1], keys[i]).
+ * Nodes are released when they become empty instead of being merged, so
+ * only the root can be a leaf without keys.
+ */
+typedef struct dirNode {
+	int leaf;
+	int count;
+	char *keys[DIR_TREE_ORDER];
+	union {
+		int inumbers[DIR_TREE_ORDER];
+		struct dirNode *children[DIR_TREE_ORDER + 1];
+	} u;
+} DirNode;
+
+/*
+ * Tree of a directory plus the Bloom filter of its names. The filter is a
+ * blocked one: each name sets a few bits of a single word. Names can't be
+ * taken out of it, so it holds every name in the tree and possibly removed
+ * ones; filter_names counts the names set since it was built, and once
+ * they are twice the names left it is rebuilt smaller. A NULL filter (out
+ * of memory when building it) lets every lookup through.
+ */
+typedef struct dirTree {
+	DirNode *root;
+	uint64_t *filter;
+	int filter_words;  /* a power of two */
+	int filter_names;
+} DirTree;
+
+/*
+ * Entries of a directory, count being their number.
+ * Inline entries are free when their inumber is FREE_INODE.
+ */
+typedef struct directory {
+	int kind;
+	int count;
+	union {
+		DirEntry entries[DIR_INLINE_ENTRIES];
+		DirArray array;
+		DirTree tree;
+	} u;
+} Directory;
+
+/*
+ * Steps of name_hash (32-bit FNV-1a), for code hashing a name as it scans
+ * it: start from NAME_HASH_INIT, apply NAME_HASH_STEP to each character and
+ * finish with NAME_HASH_END.
+ */
+#define NAME_HASH_INIT 2166136261u
+#define NAME_HASH_STEP(hash, c) (((hash) ^ (unsigned char) (c)) * 16777619u)
+/* 0 marks free slots */
+#define NAME_HASH_END(hash) ((hash) != 0 ? (hash) : 1u)
+
+/* name scan kernels, for directory_scan_kernel */
+#define DIR_SCAN_SCALAR 0
+#define DIR_SCAN_SSE2 1
+#define DIR_SCAN_AVX2 2
+
+/* finds the first of count hashes equal to hash: its position, or count */
+typedef int (*hash_scan_t)(const uint32_t *hashes, int count, uint32_t hash);
+
+uint32_t name_hash(const char *name, int len);
+hash_scan_t directory_scan_kernel(int kernel);
+void directory_init();
+void directory_create(Directory *dir);
+void directory_destroy(Directory *dir);
+int directory_find(Directory *dir, char *name);
+int directory_find_hashed(Directory *dir, char *name, int len, uint32_t hash);
+int directory_find_unlocked(Directory *dir, char *name, int len, uint32_t hash,
+                            int (*changed)(void *), void *arg);
+int directory_add(Directory *dir, int inumber, char *name);
+int directory_remove(Directory *dir, int inumber, char *name);
+int directory_is_empty(Directory *dir);
+int directory_next(Directory *dir, char *name);
+
+#endif /* DIRECTORY_H */
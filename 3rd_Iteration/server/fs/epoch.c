@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "state.h"
+#include "epoch.h"
+
+typedef struct epoch_block {
+    void *block;
+    size_t size;
+    int category;
+} epoch_block_t;
+
+/*
+ * Blocks a thread retired in one epoch. started is when the first of them
+ * was retired, to measure how long they wait.
+ */
+typedef struct epoch_bag {
+    unsigned long epoch;
+    struct timespec started;
+    epoch_block_t *blocks;
+    int count;
+    int capacity;
+} epoch_bag_t;
+
+/*
+ * Per-thread state. state is read by the threads advancing the epoch, so
+ * it has a cache line of its own; the rest is only written by the owner
+ * thread, the counters being summed by epoch_print_stats.
+ */
+typedef struct epoch_thread {
+    unsigned long state __attribute__((aligned(CACHE_LINE_SIZE))); /* epoch seen << 1 | 1 inside a read section, 0 outside */
+    int depth __attribute__((aligned(CACHE_LINE_SIZE)));          /* nested epoch_enter calls */
+    epoch_bag_t bags[EPOCH_BAGS];
+    long pending_bytes;
+    long pending_blocks;
+    long pending_exits; /* epoch_exit calls with blocks pending */
+    long reclaimed_bytes;
+    long lag_total;  /* microseconds the freed bags waited, summed */
+    long lag_max;
+    long lag_count;  /* bags freed */
+    struct epoch_thread *next;
+} epoch_thread_t;
+
+unsigned long epoch_global = 0;
+
+/*
+ * Every live thread that ever entered a read section or retired a block.
+ * Threads leave the list when they exit, so it is only walked holding the
+ * mutex.
+ */
+epoch_thread_t *epoch_threads = NULL;
+pthread_mutex_t epoch_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Bags and counters of the threads that exited, freed by whoever advances
+ * the epoch. Guarded by epoch_threads_mutex.
+ */
+epoch_thread_t epoch_orphans;
+
+/* destructor key of the per-thread state */
+pthread_key_t epoch_key;
+pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+
+static __thread epoch_thread_t *epoch_self = NULL;
+
+static void epoch_key_create();
+
+/*
+ * Returns the calling thread's state, registering it on first use.
+ */
+static epoch_thread_t *epoch_thread() {
+    epoch_thread_t *thread;
+
+    if (epoch_self != NULL)
+        return epoch_self;
+
+    if (posix_memalign((void **) &thread, CACHE_LINE_SIZE, sizeof(epoch_thread_t)) != 0) {
+        perror("Error: unable to allocate epoch thread state.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(thread, 0, sizeof(epoch_thread_t));
+    slab_charge_fixed(sizeof(epoch_thread_t), SLAB_CACHES);
+
+    pthread_mutex_lock(&epoch_threads_mutex);
+    thread->next = epoch_threads;
+    epoch_threads = thread;
+    pthread_mutex_unlock(&epoch_threads_mutex);
+
+    pthread_once(&epoch_once, epoch_key_create);
+    pthread_setspecific(epoch_key, thread);
+
+    return epoch_self = thread;
+}
+
+/*
+ * Gives the blocks of a bag back to the slab.
+ */
+static void epoch_bag_free(epoch_thread_t *thread, epoch_bag_t *bag) {
+    struct timespec now;
+    long lag;
+
+    if (bag->count == 0)
+        return;
+
+    for (int i = 0; i < bag->count; i++) {
+        slab_free(bag->blocks[i].block, bag->blocks[i].size, bag->blocks[i].category);
+        thread->pending_bytes -= bag->blocks[i].size;
+        thread->reclaimed_bytes += bag->blocks[i].size;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    lag = (now.tv_sec - bag->started.tv_sec) * 1000000 + (now.tv_nsec - bag->started.tv_nsec) / 1000;
+    thread->lag_total += lag;
+    thread->lag_count++;
+    if (lag > thread->lag_max)
+        thread->lag_max = lag;
+
+    thread->pending_blocks -= bag->count;
+    bag->count = 0;
+}
+
+/*
+ * Frees the bags of a thread that no reader can reach anymore.
+ */
+static void epoch_collect(epoch_thread_t *thread) {
+    unsigned long global = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+
+    for (int i = 0; i < EPOCH_BAGS; i++) {
+        if (thread->bags[i].epoch + 2 <= global)
+            epoch_bag_free(thread, &thread->bags[i]);
+    }
+}
+
+/*
+ * Advances the global epoch if every thread inside a read section has seen
+ * its current value, and frees the bags of exited threads that became
+ * free. Gives up if another thread holds the list.
+ */
+static void epoch_try_advance() {
+    unsigned long global = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+
+    if (pthread_mutex_trylock(&epoch_threads_mutex) != 0)
+        return;
+
+    for (epoch_thread_t *thread = epoch_threads; thread != NULL; thread = thread->next) {
+        unsigned long state = __atomic_load_n(&thread->state, __ATOMIC_SEQ_CST);
+
+        if ((state & 1) && (state >> 1) != global) {
+            pthread_mutex_unlock(&epoch_threads_mutex);
+            return;
+        }
+    }
+
+    __atomic_compare_exchange_n(&epoch_global, &global, global + 1, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+
+    if (epoch_orphans.pending_blocks > 0)
+        epoch_collect(&epoch_orphans);
+
+    pthread_mutex_unlock(&epoch_threads_mutex);
+}
+
+/*
+ * Moves the blocks of a bag to the bag of the same epoch of the exited
+ * threads. Bags sharing a slot but not an epoch are EPOCH_BAGS epochs
+ * apart, so the older one is free to go. epoch_threads_mutex must be held.
+ */
+static void epoch_bag_orphan(epoch_thread_t *thread, epoch_bag_t *bag) {
+    epoch_bag_t *orphan = &epoch_orphans.bags[bag->epoch % EPOCH_BAGS];
+
+    if (bag->count == 0)
+        return;
+
+    if (orphan->epoch > bag->epoch) {
+        epoch_bag_free(thread, bag);
+        return;
+    }
+
+    if (orphan->epoch < bag->epoch) {
+        epoch_bag_free(&epoch_orphans, orphan);
+        orphan->epoch = bag->epoch;
+    }
+
+    if (orphan->count == 0)
+        orphan->started = bag->started;
+
+    if (orphan->count + bag->count > orphan->capacity) {
+        int capacity = orphan->count + bag->count;
+        epoch_block_t *blocks = realloc(orphan->blocks, capacity * sizeof(epoch_block_t));
+
+        if (blocks == NULL) {
+            perror("Error: unable to allocate epoch bag.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        slab_charge_fixed((capacity - orphan->capacity) * sizeof(epoch_block_t), SLAB_CACHES);
+        orphan->blocks = blocks;
+        orphan->capacity = capacity;
+    }
+
+    memcpy(orphan->blocks + orphan->count, bag->blocks, bag->count * sizeof(epoch_block_t));
+    orphan->count += bag->count;
+    epoch_orphans.pending_blocks += bag->count;
+    thread->pending_blocks -= bag->count;
+    bag->count = 0;
+}
+
+/*
+ * Destructor of the per-thread state: frees what the thread can, hands
+ * the rest of its bags and its counters over to epoch_orphans, and
+ * releases the state.
+ */
+static void epoch_thread_exit(void *arg) {
+    epoch_thread_t *thread = arg, **link;
+
+    /* two steps, so that with no reader around nothing is left behind */
+    epoch_try_advance();
+    epoch_try_advance();
+    epoch_collect(thread);
+
+    pthread_mutex_lock(&epoch_threads_mutex);
+
+    for (link = &epoch_threads; *link != thread; link = &(*link)->next)
+        ;
+    *link = thread->next;
+
+    for (int i = 0; i < EPOCH_BAGS; i++) {
+        epoch_bag_orphan(thread, &thread->bags[i]);
+        free(thread->bags[i].blocks);
+        slab_uncharge(thread->bags[i].capacity * sizeof(epoch_block_t), SLAB_CACHES);
+    }
+
+    epoch_orphans.pending_bytes += thread->pending_bytes;
+    epoch_orphans.reclaimed_bytes += thread->reclaimed_bytes;
+    epoch_orphans.lag_total += thread->lag_total;
+    epoch_orphans.lag_count += thread->lag_count;
+    if (thread->lag_max > epoch_orphans.lag_max)
+        epoch_orphans.lag_max = thread->lag_max;
+
+    pthread_mutex_unlock(&epoch_threads_mutex);
+
+    free(thread);
+    slab_uncharge(sizeof(epoch_thread_t), SLAB_CACHES);
+    epoch_self = NULL;
+}
+
+static void epoch_key_create() {
+    if (pthread_key_create(&epoch_key, epoch_thread_exit) != 0) {
+        perror("Error: unable to create epoch key.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Frees what the calling thread and the exited threads retired and no
+ * reader can reach anymore. Called by the slab when a block doesn't fit
+ * under the memory limit.
+ */
+static void epoch_reclaim() {
+    epoch_thread_t *thread = epoch_thread();
+
+    /* two steps, so what was retired in the current epoch can go too */
+    epoch_try_advance();
+    epoch_try_advance();
+    epoch_collect(thread);
+}
+
+/*
+ * Lets the slab reclaim retired blocks. Must be called after slab_init.
+ */
+void epoch_init() {
+    slab_set_reclaim(epoch_reclaim);
+}
+
+/*
+ * Frees every retired block. No thread may be inside a read section.
+ */
+void epoch_destroy() {
+
+    pthread_mutex_lock(&epoch_threads_mutex);
+    for (epoch_thread_t *thread = epoch_threads; ; thread = thread->next) {
+        /* the exited threads' bags last */
+        if (thread == NULL)
+            thread = &epoch_orphans;
+
+        for (int i = 0; i < EPOCH_BAGS; i++) {
+            epoch_bag_free(thread, &thread->bags[i]);
+            free(thread->bags[i].blocks);
+            slab_uncharge(thread->bags[i].capacity * sizeof(epoch_block_t), SLAB_CACHES);
+            thread->bags[i].blocks = NULL;
+            thread->bags[i].capacity = 0;
+        }
+
+        if (thread == &epoch_orphans)
+            break;
+    }
+    pthread_mutex_unlock(&epoch_threads_mutex);
+}
+
+/*
+ * Starts a read section: blocks reached from now on stay allocated until
+ * the matching epoch_exit. Sections may be nested.
+ */
+void epoch_enter() {
+    epoch_thread_t *thread = epoch_thread();
+
+    if (thread->depth++ > 0)
+        return;
+
+    __atomic_store_n(&thread->state, (__atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST) << 1) | 1,
+                     __ATOMIC_RELAXED);
+
+    /* the state must be visible before any block is read */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit() {
+    epoch_thread_t *thread = epoch_self;
+
+    if (--thread->depth > 0)
+        return;
+
+    __atomic_store_n(&thread->state, 0, __ATOMIC_RELEASE);
+
+    /* a thread retiring fewer than EPOCH_BATCH blocks would keep them for good */
+    if (thread->pending_blocks == 0)
+        return;
+
+    if (thread->pending_bytes >= EPOCH_EXIT_BYTES || ++thread->pending_exits % EPOCH_EXIT_PERIOD == 0) {
+        epoch_try_advance();
+        epoch_collect(thread);
+    }
+}
+
+/*
+ * Frees a block once no reader can reach it anymore. It must already be
+ * unreachable for readers that start from now on.
+ * Input:
+ *  - block: the block, as returned by slab_alloc (NULL is ignored)
+ *  - size, category: as given to slab_alloc
+ */
+void epoch_retire(void *block, size_t size, int category) {
+    epoch_thread_t *thread = epoch_thread();
+    unsigned long global;
+    epoch_bag_t *bag;
+
+    if (block == NULL)
+        return;
+
+    global = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+    bag = &thread->bags[global % EPOCH_BAGS];
+
+    /* the bag last held the blocks of epoch global - EPOCH_BAGS, which are free to go */
+    if (bag->epoch != global) {
+        epoch_bag_free(thread, bag);
+        bag->epoch = global;
+    }
+
+    if (bag->count == 0)
+        clock_gettime(CLOCK_MONOTONIC, &bag->started);
+
+    if (bag->count == bag->capacity) {
+        int capacity = bag->capacity > 0 ? bag->capacity * 2 : EPOCH_BATCH;
+        epoch_block_t *blocks = realloc(bag->blocks, capacity * sizeof(epoch_block_t));
+
+        if (blocks == NULL) {
+            perror("Error: unable to allocate epoch bag.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        slab_charge_fixed((capacity - bag->capacity) * sizeof(epoch_block_t), SLAB_CACHES);
+        bag->blocks = blocks;
+        bag->capacity = capacity;
+    }
+
+    bag->blocks[bag->count].block = block;
+    bag->blocks[bag->count].size = size;
+    bag->blocks[bag->count].category = category;
+    bag->count++;
+    thread->pending_bytes += size;
+    thread->pending_blocks++;
+
+    if (bag->count % EPOCH_BATCH == 0) {
+        epoch_try_advance();
+        epoch_collect(thread);
+    }
+}
+
+/*
+ * Prints the global epoch, the bytes retired and not freed yet, and how
+ * long retired blocks waited to be freed (lag). Counters of other threads
+ * are read without synchronization, so the result is a close estimate.
+ * Input:
+ *  - fp: pointer to output file
+ */
+void epoch_print_stats(FILE *fp) {
+    long pending_bytes = 0, pending_blocks = 0, reclaimed = 0;
+    long lag_total = 0, lag_max = 0, lag_count = 0;
+
+    pthread_mutex_lock(&epoch_threads_mutex);
+    for (epoch_thread_t *thread = epoch_threads; ; thread = thread->next) {
+        if (thread == NULL)
+            thread = &epoch_orphans;
+
+        pending_bytes += thread->pending_bytes;
+        pending_blocks += thread->pending_blocks;
+        reclaimed += thread->reclaimed_bytes;
+        lag_total += thread->lag_total;
+        lag_count += thread->lag_count;
+        if (thread->lag_max > lag_max)
+            lag_max = thread->lag_max;
+
+        if (thread == &epoch_orphans)
+            break;
+    }
+    pthread_mutex_unlock(&epoch_threads_mutex);
+
+    fprintf(fp, "epoch: %lu pending %ld bytes in %ld blocks reclaimed %ld lag avg %ld max %ld us\n",
+            __atomic_load_n(&epoch_global, __ATOMIC_RELAXED), pending_bytes, pending_blocks,
+            reclaimed, lag_count > 0 ? lag_total / lag_count : 0, lag_max);
+}
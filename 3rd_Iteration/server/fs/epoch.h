@@ -0,0 +1,47 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Epoch-based reclamation for the blocks that readers follow without
+ * holding any lock (directory blocks, names, file versions). Such readers
+ * run between epoch_enter and epoch_exit, and writers retire the blocks
+ * they unlink instead of freeing them.
+ *
+ * A global epoch counter advances once every thread inside a read section
+ * has seen its current value. A block retired in epoch e is given back to
+ * the slab once the global epoch reaches e + 2: every reader that could
+ * have reached it has left its section by then. Each thread keeps what it
+ * retires in EPOCH_BAGS bags, one per epoch, and frees its own bags, so
+ * the blocks go back to its own magazines.
+ *
+ * Bags are also freed when an allocation hits the memory limit, and when
+ * a thread leaves its outermost read section with blocks pending. Since
+ * advancing locks the thread list, the latter only happens once the
+ * thread holds EPOCH_EXIT_BYTES retired, or every EPOCH_EXIT_PERIOD such
+ * exits. The bags of a thread that exits are handed over to the next
+ * thread that advances the epoch while retiring, reclaiming or exiting.
+ *
+ * Retired blocks stay charged to their category until they are freed.
+ */
+#define EPOCH_BAGS 3
+
+/* blocks a thread retires between attempts to advance the epoch */
+#define EPOCH_BATCH 64
+
+/* retired bytes past which leaving a read section tries to advance the epoch */
+#define EPOCH_EXIT_BYTES (64 * 1024)
+
+/* exits with blocks pending between attempts below EPOCH_EXIT_BYTES */
+#define EPOCH_EXIT_PERIOD 64
+
+void epoch_init();
+void epoch_destroy();
+void epoch_enter();
+void epoch_exit();
+void epoch_retire(void *block, size_t size, int category);
+void epoch_print_stats(FILE *fp);
+
+#endif /* EPOCH_H */
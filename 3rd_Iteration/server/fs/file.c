@@ -0,0 +1,506 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "state.h"
+#include "file.h"
+
+#define MAP_BYTES(count) (sizeof(FileMap) + (count) * sizeof(FileChunk *))
+
+/*
+ * Guard of the current version pointer and of the inline bytes. It is only
+ * held for a load or a store of the pointer and a reference count
+ * increment, or for a copy of at most FILE_INLINE_SIZE bytes.
+ */
+static void guard_lock(int *guard) {
+
+    while (__atomic_exchange_n(guard, 1, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(guard, __ATOMIC_RELAXED))
+            sched_yield();
+}
+
+static void guard_unlock(int *guard) {
+    __atomic_store_n(guard, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Drops a reference to a chunk, freeing it with the last one.
+ */
+static void chunk_put(FileChunk *chunk) {
+
+    if (chunk == NULL || __atomic_sub_fetch(&chunk->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    slab_free(chunk->data, FILE_CHUNK_SIZE, SLAB_FILES);
+    slab_free(chunk, sizeof(FileChunk), SLAB_FILES);
+}
+
+/*
+ * Allocates a chunk with one reference and undefined contents.
+ * Returns: the chunk, or NULL if out of memory
+ */
+static FileChunk *chunk_alloc() {
+    FileChunk *chunk;
+
+    if ((chunk = slab_alloc(sizeof(FileChunk), SLAB_FILES)) == NULL)
+        return NULL;
+
+    if ((chunk->data = slab_alloc(FILE_CHUNK_SIZE, SLAB_FILES)) == NULL) {
+        slab_free(chunk, sizeof(FileChunk), SLAB_FILES);
+        return NULL;
+    }
+
+    chunk->refs = 1;
+    return chunk;
+}
+
+/*
+ * Creates a private version that shares the chunks of another.
+ * Input:
+ *  - map: version to copy, NULL for an empty file
+ *  - count: entries of the new chunk table; chunks past it are not copied
+ *  - size: size of the new version
+ * Returns: the version, or NULL if out of memory
+ */
+static FileMap *map_copy(FileMap *map, int count, long size) {
+    int shared = map == NULL ? 0 : map->chunk_count;
+    FileMap *copy;
+
+    if (shared > count)
+        shared = count;
+
+    if ((copy = slab_alloc(MAP_BYTES(count), SLAB_FILES)) == NULL)
+        return NULL;
+
+    for (int i = 0; i < shared; i++) {
+        copy->chunks[i] = map->chunks[i];
+        if (copy->chunks[i] != NULL)
+            __atomic_add_fetch(&copy->chunks[i]->refs, 1, __ATOMIC_RELAXED);
+    }
+    memset(copy->chunks + shared, 0, (count - shared) * sizeof(FileChunk *));
+
+    copy->refs = 1;
+    copy->size = size;
+    copy->chunk_count = count;
+
+    return copy;
+}
+
+/*
+ * Gives a chunk of a private version contents of its own, so that it can
+ * be modified.
+ * Input:
+ *  - index: index of the chunk
+ *  - start, end: range of the chunk that is going to be overwritten, whose
+ *    current contents need not be copied
+ * Returns: the chunk contents, or NULL if out of memory
+ */
+static char *map_unshare(FileMap *map, int index, int start, int end) {
+    FileChunk *old = map->chunks[index], *chunk;
+
+    if ((chunk = chunk_alloc()) == NULL)
+        return NULL;
+
+    if (old != NULL) {
+        memcpy(chunk->data, old->data, start);
+        memcpy(chunk->data + end, old->data + end, FILE_CHUNK_SIZE - end);
+    }
+    else {
+        memset(chunk->data, 0, start);
+        memset(chunk->data + end, 0, FILE_CHUNK_SIZE - end);
+    }
+
+    chunk_put(old);
+    map->chunks[index] = chunk;
+
+    return chunk->data;
+}
+
+/*
+ * Writes bytes to a private version, which must already have the chunk
+ * table entries they fall in.
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+static int map_write(FileMap *map, long offset, const char *data, int len) {
+    int done = 0;
+
+    while (done < len) {
+        int start = offset & (FILE_CHUNK_SIZE - 1);
+        int size = FILE_CHUNK_SIZE - start;
+        char *chunk;
+
+        if (size > len - done)
+            size = len - done;
+
+        if ((chunk = map_unshare(map, offset >> FILE_CHUNK_SHIFT, start, start + size)) == NULL)
+            return FAIL;
+
+        memcpy(chunk + start, data + done, size);
+
+        done += size;
+        offset += size;
+    }
+
+    if (len > 0 && offset > map->size)
+        map->size = offset;
+
+    return SUCCESS;
+}
+
+/*
+ * Drops a reference to a version, retiring it with the last one (a reader
+ * in file_snapshot may still be looking at its count). Its chunks are only
+ * reached through versions holding them, so they go right away.
+ */
+static void map_release(FileMap *map) {
+
+    if (map == NULL || __atomic_sub_fetch(&map->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    for (int i = 0; i < map->chunk_count; i++)
+        chunk_put(map->chunks[i]);
+
+    epoch_retire(map, MAP_BYTES(map->chunk_count), SLAB_FILES);
+}
+
+/*
+ * Copies part of a version to a buffer, the range being within its size.
+ */
+static void map_read(FileMap *map, long offset, char *buffer, int len) {
+    int done = 0;
+
+    while (done < len) {
+        int index = offset >> FILE_CHUNK_SHIFT;
+        FileChunk *chunk = index < map->chunk_count ? map->chunks[index] : NULL;
+        int start = offset & (FILE_CHUNK_SIZE - 1);
+        int size = FILE_CHUNK_SIZE - start;
+
+        if (size > len - done)
+            size = len - done;
+
+        if (chunk != NULL)
+            memcpy(buffer + done, chunk->data + start, size);
+        else
+            memset(buffer + done, 0, size);
+
+        done += size;
+        offset += size;
+    }
+}
+
+/*
+ * Returns the size of a file. Must be called with the writer mutex held.
+ */
+static long file_size(FileData *file) {
+    return file->map == NULL ? file->inline_size : file->map->size;
+}
+
+/*
+ * Makes a version the current one and drops the file's reference to the
+ * previous one. Must be called with the writer mutex held.
+ * Input:
+ *  - map: the new version, or NULL to switch to the inline bytes
+ *  - inline_size: size of the file if map is NULL
+ */
+static void file_publish(FileData *file, FileMap *map, int inline_size) {
+    FileMap *old;
+
+    guard_lock(&file->guard);
+    old = file->map;
+    __atomic_store_n(&file->map, map, __ATOMIC_RELEASE);
+    file->inline_size = inline_size;
+    guard_unlock(&file->guard);
+
+    map_release(old);
+}
+
+/*
+ * Writes bytes to a file and publishes the result. Files that stay small
+ * are written in place, bigger ones get a new version. Must be called with
+ * the writer mutex held.
+ * Input:
+ *  - keep: 0 to write on top of an empty file instead of the current contents
+ * Returns: number of bytes written, or FAIL if the range is invalid or out
+ * of memory (the file is left unchanged)
+ */
+static int file_commit(FileData *file, int keep, long offset, const char *data, int len) {
+    long size = keep ? file_size(file) : 0, end = size;
+    FileMap *base = keep ? file->map : NULL, *map;
+    int count = base == NULL ? 0 : base->chunk_count;
+
+    if (offset < 0 || len < 0 || offset > FILE_MAX_SIZE - len)
+        return FAIL;
+
+    if (len > 0 && offset + len > end)
+        end = offset + len;
+
+    if (end <= FILE_INLINE_SIZE) {
+        if (file->map != NULL) {
+            /* readers don't look at the inline bytes until the version is gone */
+            memset(file->inline_data, 0, FILE_INLINE_SIZE);
+            memcpy(file->inline_data + offset, data, len);
+            file_publish(file, NULL, end);
+        }
+        else {
+            guard_lock(&file->guard);
+            if (!keep)
+                memset(file->inline_data, 0, file->inline_size);
+            memcpy(file->inline_data + offset, data, len);
+            file->inline_size = end;
+            guard_unlock(&file->guard);
+        }
+        return len;
+    }
+
+    if (len > 0 && count < ((offset + len - 1) >> FILE_CHUNK_SHIFT) + 1)
+        count = ((offset + len - 1) >> FILE_CHUNK_SHIFT) + 1;
+
+    if ((map = map_copy(base, count, base == NULL ? 0 : size)) == NULL)
+        return FAIL;
+
+    /* a growing inline file moves its bytes to the new version */
+    if ((keep && base == NULL && map_write(map, 0, file->inline_data, size) == FAIL) ||
+        map_write(map, offset, data, len) == FAIL) {
+        map_release(map);
+        return FAIL;
+    }
+
+    file_publish(file, map, 0);
+
+    return len;
+}
+
+/*
+ * Initializes an empty file.
+ */
+void file_create(FileData *file) {
+    file->map = NULL;
+    file->guard = 0;
+    file->inline_size = 0;
+    memset(file->inline_data, 0, FILE_INLINE_SIZE);
+
+    if (pthread_mutex_init(&file->writer, NULL) != 0) {
+        perror("Error: unable to initialize file mutex.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Releases the contents of a file. Readers holding a snapshot can keep
+ * using it.
+ */
+void file_destroy(FileData *file) {
+
+    map_release(file->map);
+    file->map = NULL;
+
+    if (pthread_mutex_destroy(&file->writer) != 0) {
+        perror("Error: unable to destroy file mutex.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Takes a reference to the current version of a file without the guard.
+ * Versions are retired, not freed, so inside an epoch one can be looked at
+ * after it is replaced; it is pinned unless its count already reached zero,
+ * in which case the file has a newer one.
+ * Returns: the version, or NULL if the contents are inline
+ */
+static FileMap *map_pin(FileData *file) {
+    FileMap *map;
+    long refs;
+
+    epoch_enter();
+
+    while ((map = __atomic_load_n(&file->map, __ATOMIC_ACQUIRE)) != NULL) {
+        refs = __atomic_load_n(&map->refs, __ATOMIC_RELAXED);
+
+        while (refs > 0 && !__atomic_compare_exchange_n(&map->refs, &refs, refs + 1, 1,
+                                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            ;
+
+        if (refs > 0)
+            break;
+    }
+
+    epoch_exit();
+    return map;
+}
+
+/*
+ * Takes a snapshot of the contents of a file, which stays valid (and
+ * unchanged) after the i-node locks are released. Small files are copied
+ * right away.
+ * Input:
+ *  - snapshot: where to store the snapshot; it must be given back with
+ *    file_snapshot_release
+ */
+void file_snapshot(FileData *file, FileSnapshot *snapshot) {
+
+    if ((snapshot->map = map_pin(file)) != NULL)
+        return;
+
+    /* the contents were inline, unless a version was published since */
+    guard_lock(&file->guard);
+    snapshot->map = file->map;
+    if (snapshot->map != NULL)
+        __atomic_add_fetch(&snapshot->map->refs, 1, __ATOMIC_RELAXED);
+    else {
+        snapshot->inline_size = file->inline_size;
+        memcpy(snapshot->inline_data, file->inline_data, file->inline_size);
+    }
+    guard_unlock(&file->guard);
+}
+
+/*
+ * Drops a snapshot taken with file_snapshot.
+ */
+void file_snapshot_release(FileSnapshot *snapshot) {
+    map_release(snapshot->map);
+    snapshot->map = NULL;
+}
+
+/*
+ * Copies part of a snapshot to a buffer.
+ * Input:
+ *  - snapshot: snapshot taken with file_snapshot
+ *  - offset: position of the first byte to read
+ *  - buffer: where to copy the bytes to
+ *  - len: maximum number of bytes to read
+ * Returns: number of bytes read (0 past the end), or FAIL if the offset is invalid
+ */
+int file_snapshot_read(FileSnapshot *snapshot, long offset, char *buffer, int len) {
+    long size = snapshot->map == NULL ? snapshot->inline_size : snapshot->map->size;
+
+    if (offset < 0 || len < 0)
+        return FAIL;
+
+    if (offset >= size)
+        return 0;
+
+    if (len > size - offset)
+        len = size - offset;
+
+    if (snapshot->map != NULL)
+        map_read(snapshot->map, offset, buffer, len);
+    else
+        memcpy(buffer, snapshot->inline_data + offset, len);
+
+    return len;
+}
+
+/*
+ * Writes bytes to a file, which grows if they go past its end; skipped
+ * bytes read as zeros. Readers see either none or all of the bytes.
+ * Input:
+ *  - offset: position of the first byte to write
+ *  - data: bytes to write
+ *  - len: number of bytes to write
+ * Returns: number of bytes written, or FAIL if the range is invalid or
+ * out of memory
+ */
+int file_write(FileData *file, long offset, const char *data, int len) {
+    int result;
+
+    pthread_mutex_lock(&file->writer);
+    result = file_commit(file, 1, offset, data, len);
+    pthread_mutex_unlock(&file->writer);
+
+    return result;
+}
+
+/*
+ * Writes bytes to the end of a file.
+ * Returns: number of bytes written, or FAIL if out of memory
+ */
+int file_append(FileData *file, const char *data, int len) {
+    int result;
+
+    pthread_mutex_lock(&file->writer);
+    result = file_commit(file, 1, file_size(file), data, len);
+    pthread_mutex_unlock(&file->writer);
+
+    return result;
+}
+
+/*
+ * Replaces the contents of a file.
+ * Returns: number of bytes written, or FAIL if out of memory
+ */
+int file_replace(FileData *file, const char *data, int len) {
+    int result;
+
+    pthread_mutex_lock(&file->writer);
+    result = file_commit(file, 0, 0, data, len);
+    pthread_mutex_unlock(&file->writer);
+
+    return result;
+}
+
+/*
+ * Changes the size of a file. Growing adds a hole; shrinking drops the
+ * chunks past the new end, and moves the contents back inline if they
+ * fit.
+ * Returns: SUCCESS or FAIL if the size is invalid or out of memory
+ */
+int file_truncate(FileData *file, long size) {
+    int keep, last = size >> FILE_CHUNK_SHIFT, tail = size & (FILE_CHUNK_SIZE - 1);
+    FileMap *map, *old;
+    long old_size;
+
+    if (size < 0 || size > FILE_MAX_SIZE)
+        return FAIL;
+
+    pthread_mutex_lock(&file->writer);
+    old = file->map;
+    old_size = file_size(file);
+
+    if (size <= FILE_INLINE_SIZE) {
+        if (old != NULL) {
+            /* readers don't look at the inline bytes until the version is gone */
+            memset(file->inline_data, 0, FILE_INLINE_SIZE);
+            map_read(old, 0, file->inline_data, size);
+            file_publish(file, NULL, size);
+        }
+        else {
+            guard_lock(&file->guard);
+            if (size < old_size)
+                memset(file->inline_data + size, 0, old_size - size);
+            file->inline_size = size;
+            guard_unlock(&file->guard);
+        }
+
+        pthread_mutex_unlock(&file->writer);
+        return SUCCESS;
+    }
+
+    keep = old == NULL ? (old_size > 0) : old->chunk_count;
+    if (size < old_size && keep > (size + FILE_CHUNK_SIZE - 1) >> FILE_CHUNK_SHIFT)
+        keep = (size + FILE_CHUNK_SIZE - 1) >> FILE_CHUNK_SHIFT;
+
+    if ((map = map_copy(old, keep, old == NULL ? 0 : size)) == NULL ||
+        (old == NULL && map_write(map, 0, file->inline_data, old_size) == FAIL)) {
+        map_release(map);
+        pthread_mutex_unlock(&file->writer);
+        return FAIL;
+    }
+    map->size = size;
+
+    /* the bytes cut from the last chunk must read as zeros if the file grows again */
+    if (size < old_size && tail != 0 && last < keep && map->chunks[last] != NULL) {
+        char *chunk = map_unshare(map, last, tail, FILE_CHUNK_SIZE);
+
+        if (chunk == NULL) {
+            map_release(map);
+            pthread_mutex_unlock(&file->writer);
+            return FAIL;
+        }
+        memset(chunk + tail, 0, FILE_CHUNK_SIZE - tail);
+    }
+
+    file_publish(file, map, 0);
+    pthread_mutex_unlock(&file->writer);
+
+    return SUCCESS;
+}
@@ -0,0 +1,76 @@
+#ifndef FILE_H
+#define FILE_H
+
+#include <limits.h>
+#include <pthread.h>
+
+/*
+ * File contents are kept in fixed-size chunks, so a file grows without
+ * reallocating its data and a write only copies the chunks it covers.
+ */
+#define FILE_CHUNK_SHIFT 12
+#define FILE_CHUNK_SIZE (1 << FILE_CHUNK_SHIFT)
+
+#define FILE_MAX_SIZE ((long) INT_MAX)
+
+/* files up to this size keep their contents in the i-node itself */
+#define FILE_INLINE_SIZE 64
+
+/*
+ * Chunk of file contents. A published chunk is never modified: a write
+ * copies it, so it can be shared by several versions of the file.
+ */
+typedef struct fileChunk {
+	long refs; /* versions that hold the chunk */
+	char *data;
+} FileChunk;
+
+/*
+ * Version of the contents of a file. chunks[i] holds bytes
+ * [i * FILE_CHUNK_SIZE, (i + 1) * FILE_CHUNK_SIZE); a NULL chunk is a hole
+ * that reads as zeros. A version is immutable once published and freed
+ * when its last holder releases it.
+ */
+typedef struct fileMap {
+	long refs; /* the file, if current, plus the readers holding it */
+	long size;
+	int chunk_count;
+	FileChunk *chunks[];
+} FileMap;
+
+/*
+ * Contents of a file. Writers serialize on the mutex and publish a new
+ * version; readers take a snapshot of the current one and copy from it
+ * without holding any lock, so neither waits for the other.
+ * Files of up to FILE_INLINE_SIZE bytes have no version: their bytes are
+ * kept inline and copied in and out under the guard.
+ */
+typedef struct fileData {
+	FileMap *map;     /* current version, NULL while the contents are inline */
+	int guard;        /* held to pin or swap the version, or to copy the inline bytes */
+	int inline_size;  /* size of the file while the contents are inline */
+	pthread_mutex_t writer;
+	char inline_data[FILE_INLINE_SIZE];
+} FileData;
+
+/*
+ * Contents of a file as of file_snapshot: a pinned version, or a copy of
+ * the inline bytes.
+ */
+typedef struct fileSnapshot {
+	FileMap *map;
+	int inline_size;
+	char inline_data[FILE_INLINE_SIZE];
+} FileSnapshot;
+
+void file_create(FileData *file);
+void file_destroy(FileData *file);
+void file_snapshot(FileData *file, FileSnapshot *snapshot);
+void file_snapshot_release(FileSnapshot *snapshot);
+int file_snapshot_read(FileSnapshot *snapshot, long offset, char *buffer, int len);
+int file_write(FileData *file, long offset, const char *data, int len);
+int file_append(FileData *file, const char *data, int len);
+int file_replace(FileData *file, const char *data, int len);
+int file_truncate(FileData *file, long size);
+
+#endif /* FILE_H */
@@ -3,43 +3,6 @@
 #include <stdio.h>
 #include <string.h>
 
-/* Given a path, fills pointers with strings for the parent path and child
- * file name
- * Input:
- *  - path: the path to split. ATENTION: the function may alter this parameter
- *  - parent: reference to a char*, to store parent path
- *  - child: reference to a char*, to store child file name
- */
-void split_parent_child_from_path(char * path, char ** parent, char ** child) {
-
-	int n_slashes = 0, last_slash_location = 0;
-	int len = strlen(path);
-
-	// deal with trailing slash ( a/x vs a/x/ )
-	if (path[len-1] == '/') {
-		path[len-1] = '\0';
-	}
-
-	for (int i=0; i < len; ++i) {
-		if (path[i] == '/' && path[i+1] != '\0') {
-			last_slash_location = i;
-			n_slashes++;
-		}
-	}
-
-	if (n_slashes == 0) { // root directory
-		*parent = "";
-		*child = path;
-		return;
-	}
-
-	path[last_slash_location] = '\0';
-	*parent = path;
-	*child = path + last_slash_location + 1;
-
-}
-
-
 /*
  * Initializes tecnicofs and creates root node.
  */
@@ -53,6 +16,9 @@ void init_fs() {
 		printf("failed to create node for tecnicofs root\n");
 		exit(EXIT_FAILURE);
 	}
+
+	/* the rest of the batch the root came from is left to the worker threads */
+	inode_cache_flush();
 }
 
 
@@ -67,110 +33,88 @@ void destroy_fs() {
 /*
  * Checks if content of directory is not empty.
  * Input:
- *  - entries: entries of directory
+ *  - dir: entries of directory
  * Returns: SUCCESS or FAIL
  */
 
-int is_dir_empty(DirEntry *dirEntries) {
-	if (dirEntries == NULL) {
+int is_dir_empty(Directory *dir) {
+	if (dir == NULL) {
 		return FAIL;
 	}
 
-	for (int i = 0; i < MAX_DIR_ENTRIES; i++) {
-
-
-		if (dirEntries[i].inumber != FREE_INODE) {
-	
-			return FAIL;
-		}
-	}
-	return SUCCESS;
+	return directory_is_empty(dir);
 }
 
 
 /*
  * Looks for node in directory entry from name.
  * Input:
- *  - name: path of node
- *  - entries: entries of directory
+ *  - name: a name of a parsed path, with its length and hash
+ *  - dir: entries of directory
  * Returns:
  *  - inumber: found node's inumber
  *  - FAIL: if not found
  */
-int lookup_sub_node(char *name, DirEntry *entries) {
-	int inumber;
+int lookup_sub_node(op_name_t *name, Directory *dir) {
 	
-	if (entries == NULL) {
+	if (dir == NULL) {
 		return FAIL;
 	}
 
-	for (int i = 0; i < MAX_DIR_ENTRIES; i++) {
-		
-        if (entries[i].inumber != FREE_INODE && strcmp(entries[i].name, name) == 0) {
-			inumber = entries[i].inumber;
-            return inumber;
-        }
-    }
-	return FAIL;
-}
-
-/*
-* Returns the number of directories existent in the path
-* Input:
-*	- name: path of node
-* Returns: number of directories
-*/
-int count_number_paths(char name[]) {
-
-	int count = 1, i;
-
-	for (i=0; name[i] != '\0'; i++ ) {
-		if (name[i] == '/')
-			count++;
-	}
-
-	if (name[i-1] == '/')
-		count--;
-
-	return count;
+	return directory_find_hashed(dir, name->name, name->len, name->hash);
 }
 
-
 /*
  * Creates a new node given a path.
  * Input:
  *  - name: path of node
  *  - nodeType: type of node
- * Returns: SUCCESS or FAIL
+ * Returns: SUCCESS, FAIL or TECNICOFS_ERROR_NO_MEMORY
  */
 int create(char *name, type nodeType){
+	return create_from(FS_ROOT, inode_get_generation(FS_ROOT), name, nodeType);
+}
 
-	int parent_inumber, child_inumber;
-	char *parent_name, *child_name, name_copy[MAX_FILE_NAME];
+
+/*
+ * Body of create_from, run with the namespace held for a change.
+ */
+static int create_from_aux(int start_inumber, unsigned int generation, char *name, type nodeType){
+
+	int parent_inumber, child_inumber, result;
+	op_context_t *context = context_get();
+	op_path_t *path = &context->paths[0];
+	op_name_t *child;
+	char *child_name;
 	/* use for copy */
-	int locked_inumbers[MAXIMUM_LOCKED_INODES];
-	int count;
 	type pType;
 	union Data pdata;
 
-	/* initialize locked inodes array */
-	for (int n=0; n< MAXIMUM_LOCKED_INODES; n++) {
-		locked_inumbers[n] = -1;
+	context_begin(context, OP_CREATE);
+
+	/* the path needs a name for the new node */
+	if (context_parse(path, name) < 1) {
+		printf("failed to create %s, invalid path\n", name);
+		return FAIL;
 	}
 
-	strcpy(name_copy, name);
+	child = &path->names[path->count - 1];
+	child_name = child->name;
 
-	count = count_number_paths(name_copy);
+	parent_inumber = lookup_from(context, start_inumber, path, path->count - 1, CREATE);
 
-	split_parent_child_from_path(name_copy, &parent_name, &child_name);
-	
-	parent_inumber = lookup(parent_name, count, locked_inumbers, CREATE, NULL);
+	/* the walk went through the starting directory: check it wasn't deleted before */
+	if (inode_check_generation(start_inumber, generation) == FAIL) {
+		printf("failed to create %s, stale handle %d\n", name, start_inumber);
+		context_unlock_all(context);
+		return TECNICOFS_ERROR_STALE_HANDLE;
+	}
 
 	/* if parent doesn't exist, return FAIL */
 	if (parent_inumber == FAIL) {
-		printf("failed to create %s, invalid parent dir %s\n",
-		        name, parent_name);
-		unlock_array(locked_inumbers);
+		printf("failed to create %s, invalid parent dir %.*s\n",
+		        name, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
@@ -178,86 +122,113 @@ int create(char *name, type nodeType){
 
 	/* if parent isn't a directory, return FAIL */
 	if(pType != T_DIRECTORY) {
-		printf("failed to create %s, parent %s is not a dir\n",
-		        name, parent_name);
+		printf("failed to create %s, parent %.*s is not a dir\n",
+		        name, path->parent_length, name);
 
-		unlock_array(locked_inumbers);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
 	/* if inode already exists, return FAIL */
-	if (lookup_sub_node(child_name, pdata.dirEntries) != FAIL) {
-		printf("failed to create %s, already exists in dir %s\n",
-		       child_name, parent_name);
-		unlock_array(locked_inumbers);
+	if (lookup_sub_node(child, pdata.dir) != FAIL) {
+		printf("failed to create %s, already exists in dir %.*s\n",
+		       child_name, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
 	/* create node and add entry to folder that contains new node */
 	child_inumber = inode_create(nodeType, parent_inumber);
 
-	/* if there is an error creating new inode, return FAIL */
+	/* if there is an error creating new inode, the memory limit was reached */
 	if (child_inumber == FAIL) {
-		printf("failed to create %s in  %s, couldn't allocate inode\n",
-		        child_name, parent_name);
-		unlock_array(locked_inumbers);
-		return FAIL;
+		printf("failed to create %s in  %.*s, couldn't allocate inode\n",
+		        child_name, path->parent_length, name);
+		context_unlock_all(context);
+		return TECNICOFS_ERROR_NO_MEMORY;
 	}
 
-	/* lock new inode and add it to the locked inodes array */
-	lock(child_inumber, READ);
-	locked_inumbers[count] = child_inumber;
+	/* lock new inode and add it to the lock set */
+	context_lock(context, child_inumber, READ);
 
-	/* add inode to parent directory and returns FAIL if it isn't successful */
-	if (dir_add_entry(parent_inumber, child_inumber, child_name) == FAIL) {
-		printf("could not add entry %s in dir %s\n",
-		       child_name, parent_name);
-		unlock_array(locked_inumbers);
-		return FAIL;
+	/* record its name for get_path, the parent is write locked */
+	if (inode_set_name(child_inumber, child_name) == FAIL) {
+		printf("failed to create %s in  %.*s, couldn't allocate name\n",
+		        child_name, path->parent_length, name);
+		inode_delete(child_inumber);
+		context_unlock_all(context);
+		return TECNICOFS_ERROR_NO_MEMORY;
+	}
+
+	/* add inode to parent directory, releasing the new inode if it isn't successful */
+	if ((result = dir_add_entry(parent_inumber, child_inumber, child_name)) != SUCCESS) {
+		printf("could not add entry %s in dir %.*s\n",
+		       child_name, path->parent_length, name);
+		inode_delete(child_inumber);
+		context_unlock_all(context);
+		return result;
 	}
 
-	/* unlocks all the inodes that were locked during lookup and the new inode itself */
-	unlock_array(locked_inumbers);
+	/* unlocks the parent and the new inode itself */
+	context_unlock_all(context);
 
 	return SUCCESS;
 }
 
 
 /*
- * Deletes a node given a path.
+ * Creates a new node given a path that starts at a directory handle.
  * Input:
- *  - name: path of node
- * Returns: SUCCESS or FAIL
+ *  - start_inumber: inumber of the directory the path starts at
+ *  - generation: generation of that directory when the handle was issued
+ *  - name: path of node, relative to the directory
+ *  - nodeType: type of node
+ * Returns: SUCCESS, FAIL, TECNICOFS_ERROR_STALE_HANDLE or TECNICOFS_ERROR_NO_MEMORY
  */
-int delete(char *name){
+int create_from(int start_inumber, unsigned int generation, char *name, type nodeType){
+	int result;
+
+	namespace_change_begin();
+	result = create_from_aux(start_inumber, generation, name, nodeType);
+	namespace_change_end();
+
+	return result;
+}
+
+
+/*
+ * Body of delete, run with the namespace held for a change.
+ */
+static int delete_aux(char *name){
 
 	int parent_inumber, child_inumber;
-	char *parent_name, *child_name, name_copy[MAX_FILE_NAME];
-	int locked_inumbers[MAXIMUM_LOCKED_INODES];
-	int count;
+	op_context_t *context = context_get();
+	op_path_t *path = &context->paths[0];
+	op_name_t *child;
+	char *child_name;
 
 	/* use for copy */
 	type pType, cType;
 	union Data pdata, cdata;
 
-	/* initialize locked inodes array */
-	for (int n=0; n< MAXIMUM_LOCKED_INODES; n++) {
-		locked_inumbers[n] = -1;
-	}
-
-	strcpy(name_copy, name);
+	context_begin(context, OP_DELETE);
 
-	count = count_number_paths(name_copy);
+	/* the root can't be deleted */
+	if (context_parse(path, name) < 1) {
+		printf("failed to delete %s, invalid path\n", name);
+		return FAIL;
+	}
 
-	split_parent_child_from_path(name_copy, &parent_name, &child_name);
+	child = &path->names[path->count - 1];
+	child_name = child->name;
 
-	parent_inumber = lookup(parent_name, count, locked_inumbers, DELETE, NULL);
+	parent_inumber = lookup(context, path, path->count - 1, DELETE);
 
 	/* if parent doesn't exist, return FAIL */
 	if (parent_inumber == FAIL) {
-		printf("failed to delete %s, invalid parent dir %s\n",
-		        child_name, parent_name);
-		unlock_array(locked_inumbers);
+		printf("failed to delete %s, invalid parent dir %.*s\n",
+		        child_name, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
@@ -265,60 +236,153 @@ int delete(char *name){
 
 	/* if parent isn't a directory, return FAIL */
 	if(pType != T_DIRECTORY) {
-		printf("failed to delete %s, parent %s is not a dir\n",
-		        child_name, parent_name);
-		unlock_array(locked_inumbers);
+		printf("failed to delete %s, parent %.*s is not a dir\n",
+		        child_name, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
-	child_inumber = lookup_sub_node(child_name, pdata.dirEntries);
+	child_inumber = lookup_sub_node(child, pdata.dir);
 
 	/* if child doesn't exist, return FAIL */
 	if (child_inumber == FAIL) {
-		printf("could not delete %s, does not exist in dir %s\n",
-		       name, parent_name);
-		unlock_array(locked_inumbers);
+		printf("could not delete %s, does not exist in dir %.*s\n",
+		       name, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
-	/* lock inode to delete and add it to locked inodes array */
-	lock(child_inumber, READ);
-	locked_inumbers[count] = child_inumber;
+	/* write lock inode to delete and add it to the lock set: lookups that
+	 * found it hold it locked, not its parent */
+	context_lock(context, child_inumber, WRITE);
 
 	inode_get(child_inumber, &cType, &cdata);
 
 	/* if inode to delete is a non-empty directory, return FAIL */
-	if (cType == T_DIRECTORY && is_dir_empty(cdata.dirEntries) == FAIL) {
+	if (cType == T_DIRECTORY && is_dir_empty(cdata.dir) == FAIL) {
 		printf("could not delete %s: is a directory and not empty\n",
 		       name);
-		unlock_array(locked_inumbers);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
 	/* remove entry from folder that contained deleted node */
-	if (dir_reset_entry(parent_inumber, child_inumber) == FAIL) {
-		printf("failed to delete %s from dir %s\n",
-		       child_name, parent_name);
-		unlock_array(locked_inumbers);
+	if (dir_reset_entry(parent_inumber, child_inumber, child_name) == FAIL) {
+		printf("failed to delete %s from dir %.*s\n",
+		       child_name, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
 	/* delete the inode, return FAIL if not successful */
 	if (inode_delete(child_inumber) == FAIL) {
-		printf("could not delete inode number %d from dir %s\n",
-		       child_inumber, parent_name);
-		unlock_array(locked_inumbers);
+		printf("could not delete inode number %d from dir %.*s\n",
+		       child_inumber, path->parent_length, name);
+		context_unlock_all(context);
 		return FAIL;
 	}
 
-	/* unlocks all the inodes that were locked during lookup and the new inode itself */
-	unlock_array (locked_inumbers);
+	/* unlocks the parent and the deleted inode itself */
+	context_unlock_all(context);
 
 	return SUCCESS;
 }
 
 /*
-* Auxiliar function used in command 'l' from main to lookup.
+ * Deletes a node given a path.
+ * Input:
+ *  - name: path of node
+ * Returns: SUCCESS or FAIL
+ */
+int delete(char *name){
+	int result;
+
+	namespace_change_begin();
+	result = delete_aux(name);
+	namespace_change_end();
+
+	return result;
+}
+
+/*
+ * Resolves a path from the root without taking any lock. Each directory's
+ * sequence is read before its entry is looked up in the dentry cache, or in
+ * the directory itself if the name isn't cached, which needs the caller to
+ * be inside an epoch read section; at the end every sequence is checked
+ * again.
+ * If none moved, each directory still had the entry that was followed when
+ * the first was checked, so the whole path existed at that point, and a
+ * missing name was missing then too.
+ * Input:
+ *  - path: names of the path
+ *  - generation: pointer to store the generation of the i-node found
+ *  - settled: set when the result is final, also if FAIL
+ * Returns:
+ *  inumber: identifier of the i-node, if found
+ *     FAIL: if not found, or if a directory changed during the walk
+ *           (settled left unset)
+ */
+static int lookup_optimistic(op_path_t *path, unsigned int *generation, int *settled) {
+	int walked[CONTEXT_MAX_NAMES];
+	unsigned int sequences[CONTEXT_MAX_NAMES];
+	int depth = 0, current_inumber = FS_ROOT, sub_inumber;
+	unsigned int current_generation = inode_get_generation(FS_ROOT), sub_generation;
+	inode_read_t read;
+	Directory *dir;
+	op_name_t *name;
+
+	for (int i = 0; i < path->count; i++) {
+		name = &path->names[i];
+
+		/* the i-node found needs no check: only the entries followed matter */
+		walked[depth] = current_inumber;
+		sequences[depth++] = inode_read_begin(current_inumber);
+
+		sub_inumber = dcache_find(current_inumber, current_generation, name->name, name->len,
+		                          name->hash, &sub_generation);
+
+		/* names that aren't cached are read from the directory itself, still without locking */
+		if (sub_inumber == FAIL) {
+			read.inumber = current_inumber;
+			read.sequence = sequences[depth - 1];
+
+			if ((dir = inode_get_dir(current_inumber)) != NULL &&
+			    inode_check_generation(current_inumber, current_generation) == SUCCESS &&
+			    (sub_inumber = directory_find_unlocked(dir, name->name, name->len, name->hash,
+			                                          inode_read_changed, &read)) != FAIL) {
+				sub_generation = inode_get_generation(sub_inumber);
+				dcache_add_unlocked(current_inumber, current_generation, name->name, name->len,
+				                    name->hash, sub_inumber, sub_generation, inode_read_changed, &read);
+			}
+
+			/* what was read may be torn if the directory changed meanwhile */
+			if (inode_read_changed(&read))
+				return FAIL;
+		}
+
+		/* not there (or not a directory) when its sequence was read, if it holds */
+		if ((current_inumber = sub_inumber) == FAIL)
+			break;
+
+		current_generation = sub_generation;
+	}
+
+	for (int i = 0; i < depth; i++) {
+		if (inode_read_retry(walked[i], sequences[i]) == SUCCESS)
+			return FAIL;
+	}
+
+	*settled = 1;
+	*generation = current_generation;
+
+	return current_inumber;
+}
+
+/*
+* Auxiliar function used in command 'l' from main to lookup. Paths found
+* are kept in the path cache, so repeating a lookup takes no lock until a
+* name is removed from some directory. Other paths are walked without
+* locking, and only under locks if directories on the way keep changing.
 * Input:
 *	- name: path of node
 * Returns:
@@ -326,195 +390,624 @@ int delete(char *name){
 *	FAIL: otherwise
 */
 int lookup_aux (char *name) {
-	int locked_inumbers[MAXIMUM_LOCKED_INODES];
-	int count = count_number_paths(name);
+	op_context_t *context = context_get();
+	op_path_t *path = &context->paths[0];
+	unsigned long version = namespace_get_version();
+	int current_inumber, settled = 0;
+	unsigned int generation;
+
+	context_begin(context, OP_LOOKUP);
+
+	if ((current_inumber = pcache_find(name, version)) != FAIL)
+		return current_inumber;
+
+	if (context_parse(path, name) == FAIL)
+		return FAIL;
+
+	epoch_enter();
+	for (int retries = 0; retries < LOOKUP_OPTIMISTIC_RETRIES && !settled; retries++)
+		current_inumber = lookup_optimistic(path, &generation, &settled);
+	epoch_exit();
 
-	/* initialize locked inodes array */
-	for (int n=0; n< MAXIMUM_LOCKED_INODES; n++) {
-		locked_inumbers[n] = -1;
+	if (settled) {
+		if (current_inumber != FAIL)
+			pcache_add(name, current_inumber, generation, version);
+		return current_inumber;
 	}
 
-	int current_inumber = lookup (name, count, locked_inumbers, LOOKUP, NULL);
+	current_inumber = lookup(context, path, path->count, LOOKUP);
 
-	unlock_array(locked_inumbers);
+	/* the i-node is locked, so its generation is the one the path led to */
+	if (current_inumber != FAIL)
+		pcache_add(name, current_inumber, inode_get_generation(current_inumber), version);
+
+	context_unlock_all(context);
 
 	return current_inumber;
 }
 
 /*
-* Checks if an inode is already locked, given a locked inumbers array
+* Opens a directory handle, used by the handle-relative operations to skip
+* walking the path from the root.
 * Input:
-* 	- current_inumber: identifier of the inode
-*	- previously_locked_inumbers: array with the inumbers of the locked inodes
+*	- name: path of the directory
+*	- generation: pointer to store the generation of the directory
 * Returns:
-*	SUCCESS: if inode is already locked 
+*	inumber: identifier of the directory, if found
 *	FAIL: otherwise
 */
-int check_lock_state(int current_inumber, int previously_locked_inumbers[]) {
-	
-	for (int i=0; previously_locked_inumbers[i] != -1 ; i++) {
-		if (previously_locked_inumbers[i] == current_inumber)
-			return SUCCESS;
+int open_dir(char *name, unsigned int *generation) {
+	op_context_t *context = context_get();
+	op_path_t *path = &context->paths[0];
+	int current_inumber;
+	type nType;
+
+	context_begin(context, OP_LOOKUP);
+
+	if (context_parse(path, name) == FAIL)
+		return FAIL;
+
+	current_inumber = lookup(context, path, path->count, LOOKUP);
+
+	if (current_inumber != FAIL) {
+		inode_get(current_inumber, &nType, NULL);
+
+		if (nType == T_DIRECTORY)
+			*generation = inode_get_generation(current_inumber);
+		else
+			current_inumber = FAIL;
+	}
+
+	context_unlock_all(context);
+
+	return current_inumber;
+}
+
+/*
+* Looks up a path that starts at a directory handle.
+* Input:
+*	- start_inumber: inumber of the directory the path starts at
+*	- generation: generation of that directory when the handle was issued
+*	- name: path of node, relative to the directory
+* Returns:
+*	inumber: identifier of the i-node, if found
+*	FAIL or TECNICOFS_ERROR_STALE_HANDLE: otherwise
+*/
+int lookup_at(int start_inumber, unsigned int generation, char *name) {
+	op_context_t *context = context_get();
+	op_path_t *path = &context->paths[0];
+	int current_inumber;
+
+	context_begin(context, OP_LOOKUP);
+
+	/* unlocked check, rejects inumbers that can't be locked; the real one is done below */
+	if (inode_check_generation(start_inumber, generation) == FAIL)
+		return TECNICOFS_ERROR_STALE_HANDLE;
+
+	/* a leading slash makes no difference, the path is relative either way */
+	if (context_parse(path, name) == FAIL)
+		return FAIL;
+
+	current_inumber = lookup_from(context, start_inumber, path, path->count, LOOKUP);
+
+	/* the walk went through the starting directory: check it wasn't deleted before */
+	if (inode_check_generation(start_inumber, generation) == FAIL)
+		current_inumber = TECNICOFS_ERROR_STALE_HANDLE;
+
+	context_unlock_all(context);
+
+	return current_inumber;
+}
+
+/*
+* Creates a new node given a path that starts at a directory handle.
+* Input:
+*	- start_inumber: inumber of the directory the path starts at
+*	- generation: generation of that directory when the handle was issued
+*	- name: path of node, relative to the directory
+*	- nodeType: type of node
+* Returns: SUCCESS, FAIL, TECNICOFS_ERROR_STALE_HANDLE or TECNICOFS_ERROR_NO_MEMORY
+*/
+int create_at(int start_inumber, unsigned int generation, char *name, type nodeType) {
+
+	/* unlocked check, rejects inumbers that can't be locked; the real one is done by create_from */
+	if (inode_check_generation(start_inumber, generation) == FAIL)
+		return TECNICOFS_ERROR_STALE_HANDLE;
+
+	return create_from(start_inumber, generation, name, nodeType);
+}
+
+/*
+* Looks up a file and read locks it, which keeps it from being deleted.
+* The contents have their own synchronization (see file.h), so writers
+* don't need to lock the file for write.
+* Input:
+*	- context: the calling thread's context, which holds the lock afterwards
+*	- name: path of the file
+*	- file: pointer to store the contents of the file
+* Returns:
+*	inumber: identifier of the file, if found
+*	FAIL: if not found or not a file
+*/
+static int lookup_file(op_context_t *context, char *name, FileData **file) {
+	op_path_t *path = &context->paths[0];
+	union Data data;
+	type nType;
+
+	context_begin(context, OP_FILE);
+
+	if (context_parse(path, name) == FAIL)
+		return FAIL;
+
+	int current_inumber = lookup(context, path, path->count, LOOKUP);
+
+	if (current_inumber == FAIL)
+		return FAIL;
+
+	inode_get(current_inumber, &nType, &data);
+	if (nType != T_FILE) {
+		printf("%s is not a file\n", name);
+		return FAIL;
+	}
+
+	*file = data.file;
+	return current_inumber;
+}
+
+/*
+* Reads part of a file. The bytes are copied from a snapshot after all
+* the locks are released, so a long read doesn't hold up writers.
+* Input:
+*	- name: path of the file
+*	- offset: position of the first byte to read
+*	- buffer: where to copy the bytes to
+*	- len: maximum number of bytes to read
+* Returns:
+*	number of bytes read, if successful
+*	FAIL: otherwise
+*/
+int read_file(char *name, long offset, char *buffer, int len) {
+	op_context_t *context = context_get();
+	FileData *file;
+	FileSnapshot snapshot;
+
+	if (lookup_file(context, name, &file) == FAIL) {
+		context_unlock_all(context);
+		return FAIL;
 	}
 
-	return FAIL;
+	file_snapshot(file, &snapshot);
+	context_unlock_all(context);
+
+	int result = file_snapshot_read(&snapshot, offset, buffer, len);
+	file_snapshot_release(&snapshot);
+
+	return result;
+}
+
+/*
+* Writes to a file, growing it if needed.
+* Input:
+*	- name: path of the file
+*	- offset: position of the first byte to write
+*	- data: bytes to write
+*	- len: number of bytes to write
+* Returns:
+*	number of bytes written, if successful
+*	FAIL: otherwise
+*/
+int write_file(char *name, long offset, char *data, int len) {
+	op_context_t *context = context_get();
+	FileData *file;
+	int result = FAIL;
+
+	if (lookup_file(context, name, &file) != FAIL)
+		result = file_write(file, offset, data, len);
+
+	context_unlock_all(context);
+
+	return result;
+}
+
+/*
+* Writes to the end of a file.
+* Input:
+*	- name: path of the file
+*	- data: bytes to write
+*	- len: number of bytes to write
+* Returns:
+*	number of bytes written, if successful
+*	FAIL: otherwise
+*/
+int append_file(char *name, char *data, int len) {
+	op_context_t *context = context_get();
+	FileData *file;
+	int result = FAIL;
+
+	if (lookup_file(context, name, &file) != FAIL)
+		result = file_append(file, data, len);
+
+	context_unlock_all(context);
+
+	return result;
 }
 
 /*
- * Lookup for a given path.
+* Changes the size of a file.
+* Input:
+*	- name: path of the file
+*	- size: the new size
+* Returns: SUCCESS or FAIL
+*/
+int truncate_file(char *name, long size) {
+	op_context_t *context = context_get();
+	FileData *file;
+	int result = FAIL;
+
+	if (lookup_file(context, name, &file) != FAIL)
+		result = file_truncate(file, size);
+
+	context_unlock_all(context);
+
+	return result;
+}
+
+/*
+* Rebuilds the path of an i-node by following the parent inumbers up to the
+* root. Only the parent of the i-node being named is locked, one at a time,
+* and the walk starts over if a move ran meanwhile, so the result is a path
+* the i-node really had.
+* Input:
+*	- inumber: identifier of the i-node
+*	- path: buffer of MAX_FILE_NAME characters to store the path
+* Returns:
+*	length of the path, if successful
+*	FAIL: if there's no such i-node or its path is too long
+*/
+int get_path(int inumber, char *path) {
+	char buffer[MAX_FILE_NAME], name[MAX_FILE_NAME];
+	int current, parent, start, len;
+	unsigned long moves;
+
+	do {
+		moves = namespace_read_begin();
+		start = MAX_FILE_NAME - 1;
+		buffer[start] = '\0';
+
+		/* the path is built backwards, from the end of the buffer */
+		for (current = inumber; current != FS_ROOT; current = parent) {
+			if ((parent = inode_get_parent(current)) == FREE_INODE)
+				return FAIL;
+
+			lock(parent, READ);
+
+			/* the i-node may have been moved or deleted before the lock was taken */
+			if (inode_get_parent(current) != parent || inode_get_name(current, name) == FAIL) {
+				unlock(parent);
+				break;
+			}
+
+			unlock(parent);
+
+			len = strlen(name);
+			if (len + 1 > start)
+				return FAIL;
+
+			start -= len;
+			memcpy(buffer + start, name, len);
+			buffer[--start] = '/';
+		}
+	} while (current != FS_ROOT || namespace_read_retry(moves) == SUCCESS);
+
+	/* the root itself */
+	if (buffer[start] == '\0')
+		buffer[--start] = '/';
+
+	strcpy(path, buffer + start);
+
+	return MAX_FILE_NAME - 1 - start;
+}
+
+/*
+ * Resolves a path through the dentry cache, for a lookup from the root.
+ * No lock is taken on the way: the directory holding the i-node found is
+ * read locked at the end, then the i-node itself as in lookup_from, and
+ * the result is kept if the name is still in that directory and no move
+ * ran since the walk began (the cache never holds a name its directory
+ * doesn't have, so the whole path was there then). Only the i-node stays
+ * locked.
+ * If only the last name isn't cached, it is looked up in its directory,
+ * so names that don't exist cost the cached walk plus one directory
+ * search (which the Bloom filter of big directories mostly skips).
  * Input:
- *  - name: path of node
- *  - count: number of directories existent in the path
- *  - locked_inumbers: array to save the inumbers of inodes that are locked while path is being covered
- *  - caller: flag to know if the last directory is locked for READ or for WRITE
- *  - previously_locked_inumbers: array only used when the caller is MOVE to check if an inode is already locked
+ *  - context: the calling thread's context, holding no lock
+ *  - path: names of the path
+ *  - count: number of names to walk, as in lookup_from
+ *  - settled: set when the result is final, also if FAIL
  * Returns:
  *  inumber: identifier of the i-node, if found
- *     FAIL: otherwise
+ *     FAIL: if not found, or if some name on the path isn't cached or the
+ *           walk was disturbed (settled left unset)
+ */
+static int lookup_cached(op_context_t *context, op_path_t *path, int count, int *settled) {
+	op_name_t *name, *last;
+	int parent_inumber = FS_ROOT, current_inumber = FS_ROOT;
+	unsigned int parent_generation, generation = inode_get_generation(FS_ROOT);
+	unsigned long moves;
+	type nType;
+	union Data data;
+
+	/* with the root as parent, lookup_from does the same */
+	if (count < 2)
+		return FAIL;
+
+	moves = namespace_read_begin();
+
+	for (int i = 0; i < count; i++) {
+		parent_inumber = current_inumber;
+		parent_generation = generation;
+
+		name = &path->names[i];
+		current_inumber = dcache_find(parent_inumber, parent_generation, name->name, name->len,
+		                              name->hash, &generation);
+
+		/* only the last name may be missing */
+		if (current_inumber == FAIL && i < count - 1)
+			return FAIL;
+	}
+
+	last = &path->names[count - 1];
+
+	context_lock(context, parent_inumber, READ);
+
+	if (inode_check_generation(parent_inumber, parent_generation) == FAIL ||
+	    inode_get(parent_inumber, &nType, &data) == FAIL || nType != T_DIRECTORY ||
+	    namespace_read_retry(moves) == SUCCESS) {
+		context_unlock(context, parent_inumber);
+		return FAIL;
+	}
+
+	*settled = 1;
+
+	/* the last name wasn't cached: the directory has the answer */
+	if (current_inumber == FAIL) {
+		if ((current_inumber = lookup_sub_node(last, data.dir)) == FAIL)
+			return FAIL;
+
+		dcache_add_hashed(parent_inumber, parent_generation, last->name, last->len, last->hash,
+		                  current_inumber, inode_get_generation(current_inumber));
+		context_lock(context, current_inumber, READ);
+		context_unlock(context, parent_inumber);
+		return current_inumber;
+	}
+
+	/* a stale entry may name an i-node recycled above the parent: check it
+	 * under the parent lock, which keeps the entry in place, before locking it */
+	if (lookup_sub_node(last, data.dir) != current_inumber ||
+	    inode_check_generation(current_inumber, generation) == FAIL) {
+		context_unlock(context, parent_inumber);
+		*settled = 0;
+		return FAIL;
+	}
+
+	context_lock(context, current_inumber, READ);
+	context_unlock(context, parent_inumber);
+
+	return current_inumber;
+}
+
+/*
+ * Lookup for a given path, starting at the root. Plain lookups try the
+ * dentry cache first.
+ * See lookup_from for the description of the arguments.
  */
-int lookup(char *name, int count, int locked_inumbers[], char caller, int previously_locked_inumbers[]) {
-	char full_path[MAX_FILE_NAME];
-	char delim[] = "/";
-	char *saveptr;
-	int i = 0;
+int lookup(op_context_t *context, op_path_t *path, int count, char caller) {
+	int inumber, settled = 0;
+
+	if (caller == LOOKUP && ((inumber = lookup_cached(context, path, count, &settled)) != FAIL || settled))
+		return inumber;
 
-	strcpy(full_path, name);
+	return lookup_from(context, FS_ROOT, path, count, caller);
+}
 
-	/* start at root node */
-	int current_inumber = FS_ROOT;
+/*
+ * Walks a path with lock coupling: each i-node is locked before the
+ * directory holding it is released, so the walk holds two locks at most
+ * and a directory stays locked only for one entry search. The entry found
+ * can't be removed meanwhile, as deletes lock the i-node they remove.
+ * See lookup_from for the description of the arguments.
+ */
+static int lookup_coupled(op_context_t *context, int start_inumber, op_path_t *path, int count, char caller) {
+	int current_inumber = start_inumber, parent_inumber;
 
 	/* use for copy */
 	type nType;
 	union Data data;
 
-	/* if path name is the root itself, lock it according to the caller and add it to the locked inodes array*/
-	if (count == 1) { 
-		lock(current_inumber, caller);
-		locked_inumbers[i] = current_inumber;
+	/* if path name is the starting directory itself, lock it according to the caller */
+	if (count == 0) {
+		context_lock(context, current_inumber, caller);
 		return current_inumber;
 	}
 
-	/* else, read lock the root and add it to the locked inodes array */
-	lock(current_inumber, READ);
-	locked_inumbers[i++] = current_inumber;
+	context_lock(context, current_inumber, READ);
 
-	inode_get(current_inumber, &nType, &data);
-	
-	char *path = strtok_r(full_path, delim, &saveptr);
-
-		/* search for all sub nodes */
-		while (path != NULL && (current_inumber = lookup_sub_node(path, data.dirEntries)) != FAIL) {
-			
-			/* if lookup was invoked by move function, only locks the inodes that were not locked yet*/
-			if (caller == MOVE) {
-				/* current_inumber already locked -> continue */
-				if (check_lock_state(current_inumber, previously_locked_inumbers) == SUCCESS){
-					inode_get(current_inumber, &nType, &data);	
-					path = strtok_r(NULL, delim, &saveptr); 
-					continue;
-				}
-			}
-			
-			/* if current_inumber is the last inode on the path, lock it according to the caller */
-			if (i == count-1) {
-				lock(current_inumber, caller);
-				locked_inumbers[i] = current_inumber;
-				return current_inumber;
-			}
+	/* the starting directory may have been deleted if it came from a handle */
+	if (inode_get(current_inumber, &nType, &data) == FAIL || nType != T_DIRECTORY)
+		return FAIL;
 
-			/* else, lock the inode for read */
-			lock(current_inumber, READ);
-			locked_inumbers[i] = current_inumber;
-			i++;
+	for (int i = 0; i < count; i++) {
+		op_name_t *name = &path->names[i];
 
-			inode_get(current_inumber, &nType, &data);	
-			path = strtok_r(NULL, delim, &saveptr); 
-		}
+		parent_inumber = current_inumber;
+
+		/* only directories have sub nodes */
+		if (nType != T_DIRECTORY || (current_inumber = lookup_sub_node(name, data.dir)) == FAIL)
+			return FAIL;
+
+		/* the directory is locked, so the name can be cached for lookup_cached */
+		dcache_add_hashed(parent_inumber, inode_get_generation(parent_inumber), name->name, name->len,
+		                  name->hash, current_inumber, inode_get_generation(current_inumber));
+
+		/* the last inode on the path is locked according to the caller, the others for read */
+		context_lock(context, current_inumber, i == count - 1 ? caller : READ);
+		context_unlock(context, parent_inumber);
+
+		inode_get(current_inumber, &nType, &data);
+	}
 
 	return current_inumber;
 }
 
 /*
-* Given the origin path from the move() function, verifies if it is a valid path according to the rules of move().
+ * Lookup for a given path, starting at a given directory. Only the i-node
+ * found stays locked; the directories above it may change as soon as the
+ * walk leaves them, but if no move ran meanwhile the whole path was there
+ * when the i-node was locked. Otherwise the walk is done again with moves
+ * kept out, so it can't be disturbed twice.
+ * Input:
+ *  - context: the calling thread's context, holding no lock; it holds the
+ *    i-node found afterwards (the last directory reached, on FAIL)
+ *  - start_inumber: inumber of the directory the path starts at
+ *  - path: names of the path
+ *  - count: number of names to walk, the first ones of the path
+ *  - caller: flag to know if the last inode is locked for READ or for WRITE
+ * Returns:
+ *  inumber: identifier of the i-node, if found
+ *     FAIL: otherwise
+ */
+int lookup_from(op_context_t *context, int start_inumber, op_path_t *path, int count, char caller) {
+	unsigned long moves = namespace_read_begin();
+	int inumber = lookup_coupled(context, start_inumber, path, count, caller);
+
+	if (namespace_read_retry(moves) == FAIL)
+		return inumber;
+
+	context_unlock_all(context);
+
+	context_rename_lock(context);
+	inumber = lookup_coupled(context, start_inumber, path, count, caller);
+	context_rename_unlock(context);
+
+	return inumber;
+}
+
+/*
+* Looks up one of the two directories of a move, without keeping it locked.
+* The caller holds the rename lock, so it stays where it is until locked
+* again; only a delete may happen meanwhile, which its generation tells.
+* Input:
+*	- context: the calling thread's context, holding no lock
+*	- path: names of the path
+*	- count: number of names of the directory's path
+*	- generation: pointer to store the generation of the directory
+* Returns:
+*	inumber: identifier of the directory, if found
+*	FAIL: otherwise
+*/
+static int lookup_move_parent(op_context_t *context, op_path_t *path, int count, unsigned int *generation) {
+	type nType;
+
+	int inumber = lookup(context, path, count, LOOKUP);
+
+	if (inumber != FAIL) {
+		inode_get(inumber, &nType, NULL);
+
+		if (nType == T_DIRECTORY)
+			*generation = inode_get_generation(inumber);
+		else
+			inumber = FAIL;
+	}
+
+	context_unlock_all(context);
+
+	return inumber;
+}
+
+/*
+* Write locks one of the two directories of a move, unless it is the other one,
+* and checks it wasn't deleted since it was looked up.
+* Input:
+*	- context: the calling thread's context
+*	- inumber: identifier of the directory
+*	- generation: its generation when it was looked up
+* Returns:
+*	- SUCCESS or FAIL
+*/
+static int lock_move_parent(op_context_t *context, int inumber, unsigned int generation) {
+
+	if (context_holds(context, inumber) == SUCCESS)
+		return SUCCESS;
+
+	context_lock(context, inumber, WRITE);
+
+	return inode_check_generation(inumber, generation);
+}
+
+/*
+* Given the origin path from the move() function, locks its parent directory and verifies if it is a valid path
+* according to the rules of move().
 * Input:
+*	- context: the calling thread's context
 *	- old_parent_inumber: inumber of the parent directory we want to move the inode from
-* 	- old_parent_name: name of the parent director we want to move the inode from
-*	- old_child_name: old name of the inode we want to move
-*	- old_path_count: number of directories on the old path
-*	- locked_origin_inumbers: array containing the inumbers of the locked inodes in the origin path
-*	- locked_final_inumbers: array containing the inumbers of the locked inodes in the final path
+*	- old_parent_generation: generation of that directory when it was looked up
+*	- old_names: names of the origin path
+*	- old_path: the origin path
 *	- inumber: inumber of the inode we want to move
 * Returns:
 *	- SUCCESS or FAIL
 */
-int validate_origin_path(int * old_parent_inumber, char * old_parent_name, char * old_child_name, int old_path_count, 
-  int locked_origin_inumbers[], int locked_final_inumbers[], int * inumber){
+int validate_origin_path(op_context_t *context, int old_parent_inumber, unsigned int old_parent_generation,
+  op_path_t *old_names, char * old_path, int * inumber){
 
-	/* if old_path's parent doesn't exist, return FAIL */
-	if ((*old_parent_inumber = lookup(old_parent_name, old_path_count, locked_origin_inumbers, MOVE, locked_final_inumbers)) == FAIL) {
-		printf("Invalid old_path parent: %s\n", old_parent_name);
-		unlock_array(locked_origin_inumbers);
-		unlock_array(locked_final_inumbers);
+	/* if old_path's parent was deleted since it was looked up, return FAIL */
+	if (lock_move_parent(context, old_parent_inumber, old_parent_generation) == FAIL) {
+		printf("Invalid old_path parent: %.*s\n", old_names->parent_length, old_path);
 		return FAIL;
 	}
 
-	
-	type nType;
 	union Data data;
-	
-	inode_get(*old_parent_inumber, &nType, &data);
+
+	inode_get(old_parent_inumber, NULL, &data);
 
 	/* if old child doesn't exist in old parent directory, return FAIL */
-	if((*inumber = lookup_sub_node(old_child_name, data.dirEntries)) == FAIL){
-		printf("Inode to move doesn't exist: %s\n", old_child_name);
-		unlock_array(locked_origin_inumbers);
-		unlock_array(locked_final_inumbers);
+	if((*inumber = lookup_sub_node(&old_names->names[old_names->count - 1], data.dir)) == FAIL){
+		printf("Inode to move doesn't exist: %s\n", old_names->names[old_names->count - 1].name);
 		return FAIL;
 	}
 
-	/* read lock inode to me moved */
-	lock(*inumber, READ);
-
-	locked_origin_inumbers[old_path_count] = *inumber;
-
 	return SUCCESS;
 
 }
 
 /*
-* Given the final path from the move() function, verifies if it is suitable to recieve the inode we want to move.
+* Given the final path from the move() function, locks its parent directory and verifies if it is suitable to
+* recieve the inode we want to move.
 * Input:
+*	- context: the calling thread's context
 *	- new_parent_inumber: inumber of the parent directory we want to move the inode to
-* 	- new_parent_name: name of the parent director we want to move the inode to
-*	- new_child_name: new name of the inode we want to move
+*	- new_parent_generation: generation of that directory when it was looked up
+*	- new_names: names of the final path
 *	- new_path: input given by the user as the new path for the inode
-*	- new_path_count: number of directories on the new_path
-*	- locked_final_inumbers: array containing the inumbers of the locked inodes in the final path
-*	- locked_origin_inumbers: array containing the inumbers of the locked inodes in the origin path
 * Returns:
 *	- SUCCESS or FAIL
 */
-int validate_final_path(int * new_parent_inumber, char * new_parent_name, char * new_child_name, char * new_path, 
-  int new_path_count, int locked_final_inumbers[], int locked_origin_inumbers[]){
-	
-	/* if new path's parent doesn't exist, return FAIL */
-	if ((*new_parent_inumber = lookup(new_parent_name, new_path_count, locked_final_inumbers, MOVE, locked_origin_inumbers)) == FAIL){
+int validate_final_path(op_context_t *context, int new_parent_inumber, unsigned int new_parent_generation,
+  op_path_t *new_names, char * new_path){
+
+	/* if new path's parent was deleted since it was looked up, return FAIL */
+	if (lock_move_parent(context, new_parent_inumber, new_parent_generation) == FAIL) {
 		printf("New path is not valid: %s\n", new_path);
-		unlock_array(locked_origin_inumbers);
-		unlock_array(locked_final_inumbers);
 		return FAIL;
 	}
 
-	type nType;
 	union Data data;
 
-	inode_get(*new_parent_inumber, &nType, &data);
+	inode_get(new_parent_inumber, NULL, &data);
 
 	/* if the new_path already exists, return FAIL */
-	if(lookup_sub_node(new_child_name, data.dirEntries) != FAIL){
+	if(lookup_sub_node(&new_names->names[new_names->count - 1], data.dir) != FAIL){
 		printf("New path already exists\n");
-		unlock_array(locked_origin_inumbers);
-		unlock_array(locked_final_inumbers);
 		return FAIL;
 	}
 
@@ -522,82 +1015,144 @@ int validate_final_path(int * new_parent_inumber, char * new_parent_name, char *
 }
 
 /*
-* Moves an inode to a different path. If it is a directory, takes all childs with it
-* Input:
-*	- old_path: path of the inode we want to move
-*	- new_path: new path we want the inode to move to
-* Returns:
-*	- SUCCESS or FAIL
-*/
-int move(char * old_path, char * new_path){
+ * Body of move, run with the namespace held for a change.
+ */
+static int move_aux(char * old_path, char * new_path){
 
 	int inumber, new_parent_inumber, old_parent_inumber;
-	/* arrays to save locked inodes when covering the old and new paths */
-	int locked_origin_inumbers[MAXIMUM_LOCKED_INODES], locked_final_inumbers[MAXIMUM_LOCKED_INODES];
-	char *new_parent_name, *new_child_name, *old_parent_name, *old_child_name;
-	char old_name_copy[MAX_FILE_NAME], new_name_copy[MAX_FILE_NAME];
-	int old_path_count = count_number_paths(old_path), new_path_count = count_number_paths(new_path);
+	unsigned int new_parent_generation, old_parent_generation;
+	/* the lock set holds both parents and the inode to move */
+	op_context_t *context = context_get();
+	op_path_t *old_names = &context->paths[0], *new_names = &context->paths[1];
+	char *new_child_name, *old_child_name;
 
-	/* initialize locked inodes arrays */
-	for (int n=0; n < MAXIMUM_LOCKED_INODES; n++) {
-		locked_origin_inumbers[n] = -1;
-		locked_final_inumbers[n] = -1;
+	context_begin(context, OP_MOVE);
+
+	/* if old_path is the root, return FAIL */
+	if (context_parse(old_names, old_path) < 1) {
+		printf("Invalid old_path: %s\n", old_path);
+		return FAIL;
 	}
 
-	strcpy(old_name_copy, new_path);
-	split_parent_child_from_path(old_name_copy, &new_parent_name, &new_child_name);
+	/* if new_path is the root, return FAIL */
+	if (context_parse(new_names, new_path) < 1) {
+		printf("New path is not valid: %s\n", new_path);
+		return FAIL;
+	}
 
-	strcpy(new_name_copy, old_path);
-	split_parent_child_from_path(new_name_copy, &old_parent_name, &old_child_name);
+	old_child_name = old_names->names[old_names->count - 1].name;
+	new_child_name = new_names->names[new_names->count - 1].name;
 
-	/* if new parent's name is the same as the inode to be moved, return FAIL */
-	if (strcmp(old_path, new_parent_name) == 0) {
-		printf("failed to move %s to %s. can't move directory inside itself.\n", old_path, new_path);
+	context_rename_lock(context);
+
+	/* if old_path's parent doesn't exist, return FAIL */
+	if ((old_parent_inumber = lookup_move_parent(context, old_names, old_names->count - 1, &old_parent_generation)) == FAIL) {
+		printf("Invalid old_path parent: %.*s\n", old_names->parent_length, old_path);
+		context_rename_unlock(context);
+		return FAIL;
+	}
+
+	/* if new path's parent doesn't exist, return FAIL */
+	if ((new_parent_inumber = lookup_move_parent(context, new_names, new_names->count - 1, &new_parent_generation)) == FAIL) {
+		printf("New path is not valid: %s\n", new_path);
+		context_rename_unlock(context);
 		return FAIL;
 	}
 
-	/* used to impose an order of search to prevent deadlocks */
-	if(old_path_count < new_path_count || (old_path_count == new_path_count && strcmp(old_parent_name, new_parent_name) <= 0))
-		if(validate_origin_path(&old_parent_inumber, old_parent_name, old_child_name, old_path_count,
-	  	  locked_origin_inumbers, locked_final_inumbers, &inumber) == FAIL) {
+	/* lock the ancestor first, if one directory lies inside the other */
+	if (inode_is_ancestor(new_parent_inumber, old_parent_inumber) == SUCCESS) {
+		if (validate_final_path(context, new_parent_inumber, new_parent_generation, new_names, new_path) == FAIL ||
+		    validate_origin_path(context, old_parent_inumber, old_parent_generation, old_names, old_path, &inumber) == FAIL) {
+			context_unlock_all(context);
+			context_rename_unlock(context);
 			return FAIL;
-			}
+		}
+	}
+	else if (validate_origin_path(context, old_parent_inumber, old_parent_generation, old_names, old_path, &inumber) == FAIL ||
+	         validate_final_path(context, new_parent_inumber, new_parent_generation, new_names, new_path) == FAIL) {
+		context_unlock_all(context);
+		context_rename_unlock(context);
+		return FAIL;
+	}
 
-	if(validate_final_path(&new_parent_inumber, new_parent_name, new_child_name, new_path, new_path_count, 
-	  locked_final_inumbers, locked_origin_inumbers) == FAIL)
+	/* if the new parent is the inode to be moved or lies inside it, return FAIL. no other move
+	 * runs, so the parents from the new parent up to the root can't change */
+	if (inode_is_ancestor(inumber, new_parent_inumber) == SUCCESS) {
+		printf("failed to move %s to %s. can't move directory inside itself.\n", old_path, new_path);
+		context_unlock_all(context);
+		context_rename_unlock(context);
 		return FAIL;
-	
-	/* used to impose an order of search to prevent deadlocks */
-	if(new_path_count < old_path_count || (old_path_count == new_path_count && strcmp(old_parent_name, new_parent_name) > 0))
-		if(validate_origin_path(&old_parent_inumber, old_parent_name, old_child_name, old_path_count,
-	  	  locked_origin_inumbers, locked_final_inumbers, &inumber) == FAIL)
-			return FAIL;
+	}
 
+	/* read lock inode to be moved, which lies below the parents only */
+	context_lock(context, inumber, READ);
 
-	/* remove the inode we want to move from its old parent directory. if not successful, return FAIL */
-	if (dir_reset_entry(old_parent_inumber, inumber) == FAIL) {
-		printf("failed to delete %s from dir %s\n",
-		       old_child_name, old_parent_name);
-		unlock_array(locked_origin_inumbers);
-		unlock_array(locked_final_inumbers);
-		return FAIL;
-	}	
+	/* get_path readers retry if they see any of the changes below */
+	namespace_move_begin();
+
+	/* add the inode to the new parent directory first, so a failure leaves it where it was */
+	if (dir_add_entry(new_parent_inumber, inumber, new_child_name) != SUCCESS) {
+		printf("could not add entry %s in dir %.*s\n",
+		       new_child_name, new_names->parent_length, new_path);
+		namespace_move_end();
+		context_unlock_all(context);
+		context_rename_unlock(context);
+		return TECNICOFS_ERROR_NO_MEMORY;
+	}
+
+	/* removing entries takes no memory, so the new entry can always be taken back */
+	if (inode_set_name(inumber, new_child_name) == FAIL) {
+		printf("failed to move %s to %s, couldn't allocate name\n", old_path, new_path);
+		dir_reset_entry(new_parent_inumber, inumber, new_child_name);
+		namespace_move_end();
+		context_unlock_all(context);
+		context_rename_unlock(context);
+		return TECNICOFS_ERROR_NO_MEMORY;
+	}
 
-	/* add the inode we want to move to the new parent directory. if not successful, return FAIL */
-	if (dir_add_entry(new_parent_inumber, inumber, new_child_name) == FAIL) {
-		printf("could not add entry %s in dir %s\n",
-		       new_child_name, new_parent_name);
-		unlock_array(locked_origin_inumbers);
-		unlock_array(locked_final_inumbers);
+	/* remove the inode we want to move from its old parent directory. if not successful, undo and return FAIL */
+	if (dir_reset_entry(old_parent_inumber, inumber, old_child_name) == FAIL) {
+		printf("failed to delete %s from dir %.*s\n",
+		       old_child_name, old_names->parent_length, old_path);
+		dir_reset_entry(new_parent_inumber, inumber, new_child_name);
+		inode_set_name(inumber, old_child_name);
+		namespace_move_end();
+		context_unlock_all(context);
+		context_rename_unlock(context);
 		return FAIL;
 	}
-	
-	/* unlock all inodes that were locked in lookup function call and were saved in both arrays */
-	unlock_array(locked_origin_inumbers);
-	unlock_array(locked_final_inumbers);
-	
+
+	inode_set_parent(inumber, new_parent_inumber);
+	namespace_move_end();
+
+	/* unlock all inodes that were locked */
+	context_unlock_all(context);
+	context_rename_unlock(context);
+
 	return SUCCESS;
-} 
+}
+
+/*
+* Moves an inode to a different path. If it is a directory, takes all childs with it.
+* Moves run one at a time, under the rename lock: the two parent directories are
+* looked up first, then locked, the ancestor first if one lies inside the other.
+* Other threads only wait for an i-node below one they hold, so this order can't
+* close a cycle.
+* Input:
+*	- old_path: path of the inode we want to move
+*	- new_path: new path we want the inode to move to
+* Returns:
+*	- SUCCESS, FAIL or TECNICOFS_ERROR_NO_MEMORY
+*/
+int move(char * old_path, char * new_path){
+	int result;
+
+	namespace_change_begin();
+	result = move_aux(old_path, new_path);
+	namespace_change_end();
+
+	return result;
+}
 
 /*
  * Prints the node tree do an output file
@@ -614,11 +1169,39 @@ int printFS(char *outFile){
         return FAIL;
     }
 
-	lock(0, WRITE);
-
+	/* no name is added, removed or moved until the whole tree is printed */
+	namespace_print_begin();
 	print_tecnicofs_tree(fo);
+	namespace_print_end();
+
+    /* closes output file */
+    if (fclose(fo) == EOF){
+        fprintf(stderr, "Error: not able do close output file\n");
+    }
+
+	return SUCCESS;
+}
+
+/*
+ * Prints the server statistics to an output file
+ * Input:
+ *  - outFile: path of the output file
+ * Returns: SUCCESS/FAIL
+ */
+int printStats(char *outFile){
+
+	/* open output file w/ validation */
+    FILE *fo;
+    if ((fo = fopen(outFile, "w")) == NULL){
+        fprintf(stderr, "Error: not able do open output file\n");
+        return FAIL;
+    }
 
-	unlock(0);
+	slab_print_stats(fo);
+	arena_print_stats(fo);
+	pcache_print_stats(fo);
+	epoch_print_stats(fo);
+	context_print_stats(fo);
 
     /* closes output file */
     if (fclose(fo) == EOF){
@@ -634,5 +1217,6 @@ int printFS(char *outFile){
  *  - fp: pointer to output file
  */
 void print_tecnicofs_tree(FILE *fp){
+	lock(FS_ROOT, READ);
 	inode_print_tree(fp, FS_ROOT, "");
 }
@@ -2,18 +2,30 @@
 #define FS_H
 #include "state.h"
 
-#define MAXIMUM_LOCKED_INODES 100
+/* lock-free walks a lookup tries before walking the path under locks */
+#define LOOKUP_OPTIMISTIC_RETRIES 4
 
 void init_fs();
 void destroy_fs();
-int is_dir_empty(DirEntry *dirEntries);
+int is_dir_empty(Directory *dir);
 int create(char *name, type nodeType);
+int create_from(int start_inumber, unsigned int generation, char *name, type nodeType);
+int create_at(int start_inumber, unsigned int generation, char *name, type nodeType);
 int delete(char *name);
-int lookup(char *name, int count, int locked_inumbers[], char caller, int previously_locked_inumbers[]);
+int lookup(op_context_t *context, op_path_t *path, int count, char caller);
+int lookup_from(op_context_t *context, int start_inumber, op_path_t *path, int count, char caller);
 int lookup_aux (char *name);
+int open_dir(char *name, unsigned int *generation);
+int lookup_at(int start_inumber, unsigned int generation, char *name);
+int read_file(char *name, long offset, char *buffer, int len);
+int write_file(char *name, long offset, char *data, int len);
+int append_file(char *name, char *data, int len);
+int truncate_file(char *name, long size);
+int get_path(int inumber, char *path);
 int move(char * old_path, char * new_path);
 void print_tecnicofs_tree(FILE *fp);
 int printFS(char *outFile);
+int printStats(char *outFile);
 
 
 #endif /* FS_H */
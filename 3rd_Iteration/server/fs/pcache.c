@@ -0,0 +1,219 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "state.h"
+#include "pcache.h"
+
+/*
+ * Per-thread hit and miss counters, only written by the owner thread and
+ * summed by pcache_print_stats.
+ */
+typedef struct pcache_thread {
+    long hits;
+    long misses;
+    struct pcache_thread *next;
+} pcache_thread_t;
+
+pcache_set_t *pcache_sets = NULL;
+
+/* every thread that ever probed the cache */
+pcache_thread_t *pcache_threads = NULL;
+pthread_mutex_t pcache_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread pcache_thread_t *pcache_self = NULL;
+
+/*
+ * Returns the calling thread's counters, registering them on first use.
+ */
+static pcache_thread_t *pcache_thread() {
+
+    if (pcache_self != NULL)
+        return pcache_self;
+
+    if ((pcache_self = calloc(1, sizeof(pcache_thread_t))) == NULL) {
+        perror("Error: unable to allocate path cache counters.\n");
+        exit(EXIT_FAILURE);
+    }
+    slab_charge_fixed(sizeof(pcache_thread_t), SLAB_CACHES);
+
+    pthread_mutex_lock(&pcache_threads_mutex);
+    pcache_self->next = pcache_threads;
+    pcache_threads = pcache_self;
+    pthread_mutex_unlock(&pcache_threads_mutex);
+
+    return pcache_self;
+}
+
+static pcache_set_t *pcache_set(uint32_t hash) {
+    return &pcache_sets[(hash * 2654435761u) >> (32 - PCACHE_SET_SHIFT)];
+}
+
+/*
+ * Returns the entry of a set holding the given path, or NULL.
+ */
+static pcache_entry_t *pcache_match(pcache_set_t *set, char *path, int len, uint32_t hash) {
+    for (int i = 0; i < PCACHE_WAYS; i++) {
+        pcache_entry_t *entry = &set->entries[i];
+
+        if (entry->hash == hash && entry->len == len && memcmp(entry->path, path, len) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void pcache_write_begin(pcache_set_t *set) {
+    unsigned int sequence;
+
+    for (;;) {
+        sequence = __atomic_load_n(&set->sequence, __ATOMIC_RELAXED);
+
+        if (!(sequence & 1) && __atomic_compare_exchange_n(&set->sequence, &sequence,
+              sequence + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+        sched_yield();
+    }
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void pcache_write_end(pcache_set_t *set) {
+    __atomic_store_n(&set->sequence, set->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Allocates the cache, empty.
+ */
+void pcache_init() {
+    if ((pcache_sets = calloc(PCACHE_SET_COUNT, sizeof(pcache_set_t))) == NULL) {
+        perror("Error: unable to allocate path cache.\n");
+        exit(EXIT_FAILURE);
+    }
+    slab_charge_fixed(PCACHE_SET_COUNT * sizeof(pcache_set_t), SLAB_CACHES);
+}
+
+void pcache_destroy() {
+    free(pcache_sets);
+    slab_uncharge(PCACHE_SET_COUNT * sizeof(pcache_set_t), SLAB_CACHES);
+    pcache_sets = NULL;
+}
+
+/*
+ * Looks a path up in the cache, without locking.
+ * Input:
+ *  - path: the path, as given to lookup
+ *  - version: namespace version read by the caller
+ * Returns: inumber the path leads to, or FAIL if it isn't cached or the
+ *  entry is out of date
+ */
+int pcache_find(char *path, unsigned long version) {
+    int len = strlen(path), inumber;
+    uint32_t hash = name_hash(path, len);
+    pcache_set_t *set = pcache_set(hash);
+    pcache_entry_t *entry;
+    unsigned int sequence, generation = 0;
+
+    if (len >= MAX_FILE_NAME)
+        return FAIL;
+
+    do {
+        while ((sequence = __atomic_load_n(&set->sequence, __ATOMIC_ACQUIRE)) & 1)
+            sched_yield();
+
+        inumber = FAIL;
+        if ((entry = pcache_match(set, path, len, hash)) != NULL && entry->version == version) {
+            inumber = entry->inumber;
+            generation = entry->generation;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&set->sequence, __ATOMIC_RELAXED) != sequence);
+
+    if (inumber != FAIL && inode_get_generation(inumber) != generation)
+        inumber = FAIL;
+
+    if (inumber == FAIL) {
+        pcache_thread()->misses++;
+        return FAIL;
+    }
+
+    /* only written when it changes, so hot entries stay shared */
+    if (!entry->referenced)
+        __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+
+    pcache_thread()->hits++;
+    return inumber;
+}
+
+/*
+ * Caches the i-node a path led to. The i-node needn't be locked (optimistic
+ * lookups add what they found unlocked): the entry is only trusted while
+ * the i-node keeps the given generation and no name was removed since
+ * version, which must have been read before the path was resolved.
+ * Input:
+ *  - path: the path, as given to lookup
+ *  - inumber: identifier of the i-node
+ *  - generation: generation of the i-node
+ *  - version: namespace version read before the lookup
+ */
+void pcache_add(char *path, int inumber, unsigned int generation, unsigned long version) {
+    int len = strlen(path);
+    uint32_t hash = name_hash(path, len);
+    pcache_set_t *set = pcache_set(hash);
+    pcache_entry_t *entry;
+
+    if (len >= MAX_FILE_NAME)
+        return;
+
+    pcache_write_begin(set);
+
+    if ((entry = pcache_match(set, path, len, hash)) == NULL) {
+        for (int i = 0; i < PCACHE_WAYS && entry == NULL; i++) {
+            if (set->entries[i].hash == 0)
+                entry = &set->entries[i];
+        }
+    }
+
+    /* clock: give the entries hit since the last pass another round */
+    while (entry == NULL) {
+        pcache_entry_t *candidate = &set->entries[set->hand];
+
+        set->hand = (set->hand + 1) % PCACHE_WAYS;
+        if (candidate->referenced)
+            candidate->referenced = 0;
+        else
+            entry = candidate;
+    }
+
+    entry->hash = hash;
+    entry->inumber = inumber;
+    entry->generation = generation;
+    entry->len = len;
+    entry->referenced = 0;
+    entry->version = version;
+    memcpy(entry->path, path, len);
+
+    pcache_write_end(set);
+}
+
+/*
+ * Prints the hits and misses of the cache. Counters of other threads are
+ * read without synchronization, so the result is a close estimate.
+ * Input:
+ *  - fp: pointer to output file
+ */
+void pcache_print_stats(FILE *fp) {
+    long hits = 0, misses = 0;
+
+    pthread_mutex_lock(&pcache_threads_mutex);
+    for (pcache_thread_t *thread = pcache_threads; thread != NULL; thread = thread->next) {
+        hits += thread->hits;
+        misses += thread->misses;
+    }
+    pthread_mutex_unlock(&pcache_threads_mutex);
+
+    fprintf(fp, "pcache: hits %ld misses %ld\n", hits, misses);
+}
@@ -0,0 +1,46 @@
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../tecnicofs-api-constants.h"
+
+/*
+ * Path cache: maps whole paths given to lookup to the i-node they led to,
+ * so a repeated lookup takes one probe and no lock. An entry keeps the
+ * namespace version read before its path was resolved and only hits while
+ * the version is the same, i.e. no name was removed from any directory
+ * since; the generation of the i-node is checked as well.
+ *
+ * The table is set associative, with a bounded number of entries. Each set
+ * is a seqlock like the buckets of the dentry cache, and a full set evicts
+ * with a CLOCK hand that passes over (and clears) the entries hit since it
+ * last went by.
+ */
+#define PCACHE_SET_SHIFT 11
+#define PCACHE_SET_COUNT (1 << PCACHE_SET_SHIFT)
+#define PCACHE_WAYS 4
+
+typedef struct pcache_entry {
+	uint32_t hash;             /* path hash, 0 for a free entry */
+	int inumber;
+	unsigned int generation;
+	unsigned char len;
+	unsigned char referenced;  /* hit since the clock hand last passed */
+	unsigned long version;
+	char path[MAX_FILE_NAME];  /* not null terminated */
+} pcache_entry_t;
+
+typedef struct pcache_set {
+	unsigned int sequence;  /* odd while a writer changes the set */
+	unsigned int hand;      /* entry the clock hand points to */
+	pcache_entry_t entries[PCACHE_WAYS];
+} __attribute__((aligned(64))) pcache_set_t;
+
+void pcache_init();
+void pcache_destroy();
+int pcache_find(char *path, unsigned long version);
+void pcache_add(char *path, int inumber, unsigned int generation, unsigned long version);
+void pcache_print_stats(FILE *fp);
+
+#endif /* PCACHE_H */
@@ -0,0 +1,576 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "slab.h"
+#include "arena.h"
+
+static const size_t slab_class_sizes[SLAB_CLASS_COUNT] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+    1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768, 49152, 65536
+};
+
+/*
+ * Shared state of a size class. Free objects in the depot are linked
+ * through their first word; pages are linked through their header.
+ */
+typedef struct slab_class {
+    pthread_mutex_t mutex;
+    void *depot;
+    long depot_count;
+    long objects;
+    long pages;
+    void *page_list;
+} slab_class_t;
+
+typedef struct slab_magazine {
+    int count;
+    void *objects[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+/*
+ * Per-thread state. Counters are only written by the owner thread and
+ * summed by slab_get_stats.
+ */
+typedef struct slab_thread {
+    slab_magazine_t magazines[SLAB_CLASS_COUNT];
+    long allocs[SLAB_CLASS_COUNT + 1];
+    long frees[SLAB_CLASS_COUNT + 1];
+    long bytes[SLAB_CATEGORY_COUNT]; /* net bytes charged by this thread */
+    long credit; /* bytes taken from the limit and not charged yet */
+    struct slab_thread *next;
+} slab_thread_t;
+
+/* page header, objects follow it */
+typedef struct slab_page {
+    struct slab_page *next;
+    char pad[8]; /* keeps the objects 16-byte aligned */
+} slab_page_t;
+
+slab_class_t slab_classes[SLAB_CLASS_COUNT];
+
+/* every thread that ever used the pool */
+slab_thread_t *slab_threads = NULL;
+pthread_mutex_t slab_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* counters of the threads that exited, guarded by slab_threads_mutex */
+slab_thread_t slab_exited;
+
+/* destructor key of the per-thread state */
+pthread_key_t slab_key;
+pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+
+static __thread slab_thread_t *slab_self = NULL;
+
+static void slab_key_create();
+
+static const char *slab_category_names[SLAB_CATEGORY_COUNT] = {
+    "inodes", "directories", "names", "files", "caches"
+};
+
+/* memory limit in bytes, 0 for none */
+size_t slab_limit = 0;
+
+/* bytes the threads have taken from the limit */
+long slab_reserved = 0;
+
+/* frees blocks held for later (retired ones) when the limit is reached, or NULL */
+static void (*slab_reclaim)() = NULL;
+
+/*
+ * Returns the size class for a block size, or SLAB_CLASS_COUNT if the
+ * block is too big to be pooled.
+ */
+static int slab_class_of(size_t size) {
+    int low = 0, high = SLAB_CLASS_COUNT;
+
+    /* first class whose size is >= size */
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (slab_class_sizes[middle] < size)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/*
+ * Returns the calling thread's state, registering it on first use.
+ */
+static slab_thread_t *slab_thread() {
+
+    if (slab_self != NULL)
+        return slab_self;
+
+    if ((slab_self = calloc(1, sizeof(slab_thread_t))) == NULL) {
+        perror("Error: unable to allocate slab thread state.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&slab_threads_mutex);
+    slab_self->next = slab_threads;
+    slab_threads = slab_self;
+    pthread_mutex_unlock(&slab_threads_mutex);
+
+    pthread_once(&slab_once, slab_key_create);
+    pthread_setspecific(slab_key, slab_self);
+
+    return slab_self;
+}
+
+/*
+ * Carves a new page into objects and puts them in the depot.
+ * Must be called with the class mutex held.
+ * Returns: 0 on success, -1 if out of memory
+ */
+static int slab_grow(int size_class) {
+    slab_class_t *class = &slab_classes[size_class];
+    size_t size = slab_class_sizes[size_class];
+    size_t count = SLAB_PAGE_SIZE / size;
+    slab_page_t *page;
+    char *object;
+
+    if (count < SLAB_MAGAZINE_SIZE / 2)
+        count = SLAB_MAGAZINE_SIZE / 2;
+
+    page = arena_alloc(sizeof(slab_page_t) + count * size, sizeof(slab_page_t));
+    if (page == NULL && (page = malloc(sizeof(slab_page_t) + count * size)) == NULL)
+        return -1;
+
+    page->next = class->page_list;
+    class->page_list = page;
+    class->pages++;
+
+    object = (char *) (page + 1);
+    for (size_t i = 0; i < count; i++, object += size) {
+        *(void **) object = class->depot;
+        class->depot = object;
+    }
+
+    class->depot_count += count;
+    class->objects += count;
+
+    return 0;
+}
+
+/*
+ * Moves up to half a magazine of objects from the depot to a magazine.
+ */
+static void slab_refill(int size_class, slab_magazine_t *magazine) {
+    slab_class_t *class = &slab_classes[size_class];
+
+    pthread_mutex_lock(&class->mutex);
+
+    if (class->depot == NULL && slab_grow(size_class) != 0) {
+        pthread_mutex_unlock(&class->mutex);
+        return;
+    }
+
+    while (magazine->count < SLAB_MAGAZINE_SIZE / 2 && class->depot != NULL) {
+        void *object = class->depot;
+
+        class->depot = *(void **) object;
+        class->depot_count--;
+        magazine->objects[magazine->count++] = object;
+    }
+
+    pthread_mutex_unlock(&class->mutex);
+}
+
+/*
+ * Moves the objects of a magazine back to the depot until keep are left.
+ */
+static void slab_flush(int size_class, slab_magazine_t *magazine, int keep) {
+    slab_class_t *class = &slab_classes[size_class];
+
+    pthread_mutex_lock(&class->mutex);
+
+    while (magazine->count > keep) {
+        void *object = magazine->objects[--magazine->count];
+
+        *(void **) object = class->depot;
+        class->depot = object;
+        class->depot_count++;
+    }
+
+    pthread_mutex_unlock(&class->mutex);
+}
+
+/*
+ * Destructor of the per-thread state: empties the thread's magazines into
+ * the depots, gives its unused credit back to the limit, adds its counters
+ * to slab_exited and releases the state.
+ */
+static void slab_thread_exit(void *arg) {
+    slab_thread_t *thread = arg, **link;
+
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++)
+        slab_flush(i, &thread->magazines[i], 0);
+
+    if (thread->credit > 0)
+        __atomic_sub_fetch(&slab_reserved, thread->credit, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&slab_threads_mutex);
+
+    for (link = &slab_threads; *link != thread; link = &(*link)->next)
+        ;
+    *link = thread->next;
+
+    for (int i = 0; i <= SLAB_CLASS_COUNT; i++) {
+        slab_exited.allocs[i] += thread->allocs[i];
+        slab_exited.frees[i] += thread->frees[i];
+    }
+    for (int i = 0; i < SLAB_CATEGORY_COUNT; i++)
+        slab_exited.bytes[i] += thread->bytes[i];
+
+    pthread_mutex_unlock(&slab_threads_mutex);
+
+    free(thread);
+    slab_self = NULL;
+}
+
+static void slab_key_create() {
+    if (pthread_key_create(&slab_key, slab_thread_exit) != 0) {
+        perror("Error: unable to create slab key.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Takes bytes from the memory limit.
+ * Returns: 0 on success, -1 if that would go over the limit
+ */
+static int slab_reserve(long bytes) {
+    long reserved = __atomic_load_n(&slab_reserved, __ATOMIC_RELAXED);
+
+    do {
+        if (reserved + bytes > (long) slab_limit)
+            return -1;
+    } while (!__atomic_compare_exchange_n(&slab_reserved, &reserved, reserved + bytes, 1,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return 0;
+}
+
+/*
+ * Sets the most bytes the blocks of every category may hold together.
+ * Only blocks in use count: free objects kept in the pool don't.
+ * Must be called before any allocation.
+ * Input:
+ *  - bytes: the limit, 0 for none
+ */
+void slab_set_limit(size_t bytes) {
+    slab_limit = bytes;
+}
+
+/*
+ * Sets the function slab_charge calls before failing, to free blocks that
+ * are only waiting to be freed.
+ */
+void slab_set_reclaim(void (*reclaim)()) {
+    slab_reclaim = reclaim;
+}
+
+/*
+ * Takes bytes from the memory limit for a thread's credit.
+ * Returns: 0 on success, -1 if they don't fit
+ */
+static int slab_take_credit(slab_thread_t *thread, size_t size) {
+    long missing = size - thread->credit;
+
+    /* take a whole batch if it fits, or just what's missing near the limit */
+    if (slab_reserve(missing + SLAB_CREDIT_BATCH) == 0)
+        thread->credit += missing + SLAB_CREDIT_BATCH;
+    else if (slab_reserve(missing) == 0)
+        thread->credit += missing;
+    else
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Accounts for memory about to be used. slab_alloc does it for its blocks;
+ * memory allocated elsewhere is charged with this directly. Near the limit,
+ * blocks waiting to be freed are reclaimed before giving up.
+ * Input:
+ *  - size: number of bytes
+ *  - category: what the memory is used for (SLAB_INODES, ...)
+ * Returns: 0 on success, -1 if the memory limit would be exceeded
+ */
+int slab_charge(size_t size, int category) {
+    slab_thread_t *thread = slab_thread();
+
+    if (slab_limit != 0 && thread->credit < (long) size && slab_take_credit(thread, size) != 0) {
+        if (slab_reclaim == NULL)
+            return -1;
+
+        /* reclaiming frees blocks, which may leave enough credit */
+        slab_reclaim();
+        if (thread->credit < (long) size && slab_take_credit(thread, size) != 0)
+            return -1;
+    }
+
+    thread->credit -= size;
+    thread->bytes[category] += size;
+    return 0;
+}
+
+/*
+ * Accounts for memory the server can't do without, such as its caches and
+ * the state of each thread. Unlike slab_charge it never fails: past the
+ * limit the memory is still counted, so blocks run out sooner instead.
+ * Input:
+ *  - size: number of bytes
+ *  - category: what the memory is used for (SLAB_CACHES, ...)
+ */
+void slab_charge_fixed(size_t size, int category) {
+    slab_thread_t *thread = slab_thread();
+
+    if (slab_limit != 0 && thread->credit < (long) size && slab_take_credit(thread, size) != 0) {
+        __atomic_add_fetch(&slab_reserved, size - thread->credit, __ATOMIC_RELAXED);
+        thread->credit = size;
+    }
+
+    thread->credit -= size;
+    thread->bytes[category] += size;
+}
+
+/*
+ * Accounts for memory no longer used.
+ * Input:
+ *  - size: number of bytes, as charged
+ *  - category: what the memory was used for
+ */
+void slab_uncharge(size_t size, int category) {
+    slab_thread_t *thread = slab_thread();
+
+    thread->bytes[category] -= size;
+
+    if (slab_limit == 0)
+        return;
+
+    /* give back what this thread isn't likely to use soon */
+    thread->credit += size;
+    if (thread->credit > 2 * SLAB_CREDIT_BATCH) {
+        __atomic_sub_fetch(&slab_reserved, thread->credit - SLAB_CREDIT_BATCH, __ATOMIC_RELAXED);
+        thread->credit = SLAB_CREDIT_BATCH;
+    }
+}
+
+/*
+ * Returns the bytes held by a category. Counters of other threads are read
+ * without synchronization, so the result is a close estimate while
+ * operations are running, and exact otherwise.
+ */
+long slab_category_bytes(int category) {
+    long bytes;
+
+    pthread_mutex_lock(&slab_threads_mutex);
+    bytes = slab_exited.bytes[category];
+    for (slab_thread_t *thread = slab_threads; thread != NULL; thread = thread->next)
+        bytes += thread->bytes[category];
+    pthread_mutex_unlock(&slab_threads_mutex);
+
+    return bytes;
+}
+
+/*
+ * Initializes the size classes.
+ */
+void slab_init() {
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        if (pthread_mutex_init(&slab_classes[i].mutex, NULL) != 0) {
+            perror("Error: unable to init slab mutex.\n");
+            exit(EXIT_FAILURE);
+        }
+        slab_classes[i].depot = NULL;
+        slab_classes[i].depot_count = 0;
+        slab_classes[i].objects = 0;
+        slab_classes[i].pages = 0;
+        slab_classes[i].page_list = NULL;
+    }
+}
+
+/*
+ * Releases every page of the pool. Objects still handed out become invalid.
+ */
+void slab_destroy() {
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slab_page_t *page = slab_classes[i].page_list, *next;
+
+        for (; page != NULL; page = next) {
+            next = page->next;
+            if (!arena_contains(page))
+                free(page);
+        }
+
+        slab_classes[i].page_list = NULL;
+        slab_classes[i].depot = NULL;
+        pthread_mutex_destroy(&slab_classes[i].mutex);
+    }
+
+    pthread_mutex_lock(&slab_threads_mutex);
+    for (slab_thread_t *thread = slab_threads; thread != NULL; thread = thread->next)
+        for (int i = 0; i < SLAB_CLASS_COUNT; i++)
+            thread->magazines[i].count = 0;
+    pthread_mutex_unlock(&slab_threads_mutex);
+}
+
+/*
+ * Returns the bytes a block of the given size really holds.
+ */
+static size_t slab_block_size(size_t size) {
+    int size_class = slab_class_of(size);
+
+    return size_class == SLAB_CLASS_COUNT ? size : slab_class_sizes[size_class];
+}
+
+/*
+ * Allocates a block.
+ * Input:
+ *  - size: size of the block, in bytes
+ *  - category: what the block is used for (SLAB_DIRECTORIES, ...)
+ * Returns: the block, or NULL if out of memory or over the memory limit
+ */
+void *slab_alloc(size_t size, int category) {
+    slab_thread_t *thread = slab_thread();
+    int size_class = slab_class_of(size);
+    slab_magazine_t *magazine;
+
+    if (slab_charge(slab_block_size(size), category) != 0)
+        return NULL;
+
+    if (size_class == SLAB_CLASS_COUNT) {
+        void *object = malloc(size);
+
+        if (object != NULL)
+            thread->allocs[size_class]++;
+        else
+            slab_uncharge(size, category);
+        return object;
+    }
+
+    magazine = &thread->magazines[size_class];
+    if (magazine->count == 0) {
+        slab_refill(size_class, magazine);
+
+        if (magazine->count == 0) {
+            slab_uncharge(slab_block_size(size), category);
+            return NULL;
+        }
+    }
+
+    thread->allocs[size_class]++;
+    return magazine->objects[--magazine->count];
+}
+
+/*
+ * Releases a block for reuse.
+ * Input:
+ *  - object: block returned by slab_alloc (may be NULL)
+ *  - size: size the block was allocated with
+ *  - category: category the block was allocated with
+ */
+void slab_free(void *object, size_t size, int category) {
+    slab_thread_t *thread;
+    int size_class;
+    slab_magazine_t *magazine;
+
+    if (object == NULL)
+        return;
+
+    slab_uncharge(slab_block_size(size), category);
+
+    thread = slab_thread();
+    size_class = slab_class_of(size);
+    thread->frees[size_class]++;
+
+    if (size_class == SLAB_CLASS_COUNT) {
+        free(object);
+        return;
+    }
+
+    magazine = &thread->magazines[size_class];
+    if (magazine->count == SLAB_MAGAZINE_SIZE)
+        slab_flush(size_class, magazine, SLAB_MAGAZINE_SIZE / 2);
+
+    magazine->objects[magazine->count++] = object;
+}
+
+/*
+ * Reads the usage of a size class. Counters of other threads are read
+ * without synchronization, so the result is a close estimate.
+ * Input:
+ *  - size_class: index of the class, or SLAB_CLASS_COUNT for big blocks
+ *  - stats: pointer to store the usage
+ */
+void slab_get_stats(int size_class, slab_stats_t *stats) {
+    long allocs, frees;
+
+    pthread_mutex_lock(&slab_threads_mutex);
+    allocs = slab_exited.allocs[size_class];
+    frees = slab_exited.frees[size_class];
+    for (slab_thread_t *thread = slab_threads; thread != NULL; thread = thread->next) {
+        allocs += thread->allocs[size_class];
+        frees += thread->frees[size_class];
+    }
+    pthread_mutex_unlock(&slab_threads_mutex);
+
+    stats->live = allocs - frees;
+
+    if (size_class == SLAB_CLASS_COUNT) {
+        stats->size = 0;
+        stats->free = 0;
+        stats->high_water = stats->live;
+        stats->pages = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&slab_classes[size_class].mutex);
+    stats->size = slab_class_sizes[size_class];
+    stats->high_water = slab_classes[size_class].objects;
+    stats->pages = slab_classes[size_class].pages;
+    pthread_mutex_unlock(&slab_classes[size_class].mutex);
+
+    stats->free = stats->high_water - stats->live;
+}
+
+/*
+ * Prints the usage of every size class that was ever used, and the bytes
+ * held by each category.
+ * Input:
+ *  - fp: pointer to output file
+ */
+void slab_print_stats(FILE *fp) {
+    slab_stats_t stats;
+    long total = 0;
+
+    fprintf(fp, "slab: size live free high_water pages\n");
+
+    for (int i = 0; i <= SLAB_CLASS_COUNT; i++) {
+        slab_get_stats(i, &stats);
+
+        if (stats.high_water == 0 && stats.live == 0)
+            continue;
+
+        fprintf(fp, "slab: %zu %ld %ld %ld %ld\n", stats.size, stats.live,
+                stats.free, stats.high_water, stats.pages);
+    }
+
+    fprintf(fp, "memory: category bytes\n");
+
+    for (int i = 0; i < SLAB_CATEGORY_COUNT; i++) {
+        long bytes = slab_category_bytes(i);
+
+        total += bytes;
+        fprintf(fp, "memory: %s %ld\n", slab_category_names[i], bytes);
+    }
+
+    fprintf(fp, "memory: total %ld\n", total);
+    if (slab_limit != 0)
+        fprintf(fp, "memory: limit %zu\n", slab_limit);
+}
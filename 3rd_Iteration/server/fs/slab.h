@@ -0,0 +1,73 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Size-class pool for the fs' variable sized blocks (directory blocks).
+ * Each thread keeps a magazine of free objects per size class, so most
+ * allocations and frees never touch shared state; a thread's magazines go
+ * back to the depot when it exits. Freed objects are kept for reuse and
+ * only given back to the system by slab_destroy. Pages are carved from
+ * the arena while it has room.
+ */
+
+/* number of size classes, from 16 bytes to SLAB_MAX_SIZE */
+#define SLAB_CLASS_COUNT 24
+#define SLAB_MAX_SIZE 65536
+
+/* objects cached per thread and size class */
+#define SLAB_MAGAZINE_SIZE 32
+
+/* minimum size of the pages objects are carved from */
+#define SLAB_PAGE_SIZE 65536
+
+/*
+ * What a block is used for. The bytes held by each category are counted,
+ * and all of them count towards the memory limit. The limit bounds the
+ * blocks in use, at the size of their class, and the caches and per-thread
+ * state charged with slab_charge_fixed, not the memory of the process:
+ * pages are never given back, so after many frees the pool may hold up to
+ * its high water mark (see slab_print_stats) on top of it.
+ */
+#define SLAB_INODES 0       /* i-node table segments */
+#define SLAB_DIRECTORIES 1  /* directory entries, hashes, tree nodes and filters */
+#define SLAB_NAMES 2        /* directory name heaps and keys, i-node names */
+#define SLAB_FILES 3        /* file versions and chunks */
+#define SLAB_CACHES 4       /* lookup caches, per-thread state and epoch bags */
+#define SLAB_CATEGORY_COUNT 5
+
+/*
+ * Bytes a thread takes from the memory limit at a time, so that most
+ * allocations don't touch shared state. The limit is never exceeded, but
+ * near it up to this much per thread may be held as unused credit.
+ */
+#define SLAB_CREDIT_BATCH (256 * 1024)
+
+/*
+ * Usage of one size class. Blocks bigger than SLAB_MAX_SIZE are reported
+ * with size 0.
+ */
+typedef struct slab_stats {
+	size_t size;      /* object size of the class */
+	long live;        /* objects handed out and not freed yet */
+	long free;        /* objects ready for reuse (depot and magazines) */
+	long high_water;  /* most objects ever held by the class (live + free) */
+	long pages;       /* pages carved for the class */
+} slab_stats_t;
+
+void slab_init();
+void slab_destroy();
+void slab_set_limit(size_t bytes);
+void slab_set_reclaim(void (*reclaim)());
+int slab_charge(size_t size, int category);
+void slab_charge_fixed(size_t size, int category);
+void slab_uncharge(size_t size, int category);
+long slab_category_bytes(int category);
+void *slab_alloc(size_t size, int category);
+void slab_free(void *object, size_t size, int category);
+void slab_get_stats(int size_class, slab_stats_t *stats);
+void slab_print_stats(FILE *fp);
+
+#endif /* SLAB_H */
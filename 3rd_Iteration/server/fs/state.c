@@ -3,24 +3,325 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <sched.h>
+#include <errno.h>
 #include "state.h"
 #include "../tecnicofs-api-constants.h"
 
-inode_t inode_table[INODE_TABLE_SIZE];
+/* segment directory: entry i holds i-nodes [i*INODE_SEGMENT_SIZE, (i+1)*INODE_SEGMENT_SIZE) */
+inode_segment_t *inode_segments[INODE_SEGMENT_COUNT];
+
+/* number of inumbers claimed so far, always a multiple of INODE_CACHE_BATCH */
+int inode_table_top = 0;
 
 /*
- * Initializes the i-nodes table.
+ * Shared stack of free inumbers, linked through the next_free array.
+ * The low 32 bits hold the top inumber (FREE_INODE if empty) and the high
+ * 32 bits a counter bumped on every update, so a pop cannot be fooled by
+ * an inumber that was popped and pushed back in between (ABA).
  */
-void inode_table_init() {
-    for (int i = 0; i < INODE_TABLE_SIZE; i++) {
-        inode_table[i].nodeType = T_NONE;
-        inode_table[i].data.dirEntries = NULL;
-        inode_table[i].data.fileContents = NULL;
-        if(pthread_rwlock_init(&inode_table[i].rwlock, NULL) != 0) {
+uint64_t inode_free_stack;
+
+/*
+ * Moves started and finished so far. A reader that saw them equal and
+ * sees the same number of started moves later knew no move in between.
+ */
+unsigned long namespace_moves_started = 0;
+unsigned long namespace_moves_finished = 0;
+
+/*
+ * Held by a move for its whole duration, so moves run one at a time and no
+ * other i-node changes parent while one looks its two directories up.
+ */
+pthread_mutex_t namespace_rename_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Read locked by every operation that adds, removes or moves a name, and
+ * write locked by printFS, so that a dump sees the tree as it was between
+ * two such operations. Writers go first, so dumps aren't starved.
+ */
+pthread_rwlock_t namespace_print_rwlock;
+
+/*
+ * Names removed from directories so far, by deletes and moves. While it
+ * doesn't change, every path that led to an i-node still leads to it.
+ */
+unsigned long namespace_version = 0;
+
+/*
+ * Bumped every time the table is created or destroyed, so that inumbers a
+ * thread cached from an older table are dropped instead of used.
+ */
+unsigned long inode_table_instance = 0;
+
+/* given back to the shared stack by inode_cache_flush when a thread exits */
+pthread_key_t inode_cache_key;
+pthread_once_t inode_cache_once = PTHREAD_ONCE_INIT;
+
+/* free inumbers owned by the calling thread, taken from table inode_cache_instance */
+static __thread int inode_cache[INODE_CACHE_SIZE];
+static __thread int inode_cache_count = 0;
+static __thread unsigned long inode_cache_instance = 0;
+
+#define FREE_STACK_PACK(tag, inumber) (((uint64_t) (tag) << 32) | (uint32_t) (inumber))
+#define FREE_STACK_TAG(head) ((uint32_t) ((head) >> 32))
+#define FREE_STACK_TOP(head) ((int) (uint32_t) (head))
+
+/* position of an i-node inside its segment */
+#define INODE_INDEX(inumber) ((inumber) & (INODE_SEGMENT_SIZE - 1))
+
+/*
+ * Returns the segment holding the given inumber, or NULL if the inumber is
+ * out of range or its segment was never allocated.
+ */
+static inode_segment_t *inode_segment(int inumber) {
+
+    if ((inumber < 0) || (inumber >= INODE_TABLE_SIZE))
+        return NULL;
+
+    return __atomic_load_n(&inode_segments[inumber >> INODE_SEGMENT_SHIFT], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Returns the type of an i-node, or T_NONE if the inumber is invalid.
+ */
+static type inode_type(int inumber) {
+    inode_segment_t *segment = inode_segment(inumber);
+
+    if (segment == NULL)
+        return T_NONE;
+
+    return segment->types[INODE_INDEX(inumber)];
+}
+
+/*
+ * Accessors for the remaining fields of an i-node. The inumber must belong
+ * to an allocated segment.
+ */
+static union Data *inode_data(int inumber) {
+    return &inode_segment(inumber)->data[INODE_INDEX(inumber)];
+}
+
+static int *inode_next_free(int inumber) {
+    return &inode_segment(inumber)->next_free[INODE_INDEX(inumber)];
+}
+
+static unsigned int *inode_sequence(int inumber) {
+    return &inode_segment(inumber)->sequences[INODE_INDEX(inumber)];
+}
+
+static pthread_rwlock_t *inode_rwlock(int inumber) {
+    return &inode_segment(inumber)->locks[INODE_INDEX(inumber)].rwlock;
+}
+
+/*
+ * Returns the segment with the given index, allocating it if needed.
+ * Concurrent callers race with a compare-and-swap; the loser releases its
+ * copy, so growing the table never takes a global lock.
+ */
+static inode_segment_t *inode_segment_get(int index) {
+    inode_segment_t *segment, *expected = NULL;
+
+    segment = __atomic_load_n(&inode_segments[index], __ATOMIC_ACQUIRE);
+    if (segment != NULL)
+        return segment;
+
+    if (slab_charge(sizeof(inode_segment_t), SLAB_INODES) != 0)
+        return NULL;
+
+    segment = arena_alloc(sizeof(inode_segment_t), CACHE_LINE_SIZE);
+    if (segment == NULL &&
+        posix_memalign((void **) &segment, CACHE_LINE_SIZE, sizeof(inode_segment_t)) != 0) {
+        perror("Error: unable to allocate i-node segment.\n");
+        slab_uncharge(sizeof(inode_segment_t), SLAB_INODES);
+        return NULL;
+    }
+
+    for (int i = 0; i < INODE_SEGMENT_SIZE; i++) {
+        segment->types[i] = T_NONE;
+        segment->data[i].dir = NULL;
+        segment->generations[i] = 0;
+        segment->sequences[i] = 0;
+        if(pthread_rwlock_init(&segment->locks[i].rwlock, NULL) != 0) {
             perror("Error: unable to init rwlock.\n");
             exit(EXIT_FAILURE);
         }
     }
+
+    if (!__atomic_compare_exchange_n(&inode_segments[index], &expected, segment, 0,
+      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* another thread published this segment first (an arena copy stays unused) */
+        for (int i = 0; i < INODE_SEGMENT_SIZE; i++)
+            pthread_rwlock_destroy(&segment->locks[i].rwlock);
+        if (!arena_contains(segment))
+            free(segment);
+        slab_uncharge(sizeof(inode_segment_t), SLAB_INODES);
+        segment = expected;
+    }
+
+    return segment;
+}
+
+/*
+ * Pushes a free inumber onto the shared stack.
+ */
+static void free_stack_push(int inumber) {
+    uint64_t head = __atomic_load_n(&inode_free_stack, __ATOMIC_ACQUIRE), new_head;
+
+    do {
+        *inode_next_free(inumber) = FREE_STACK_TOP(head);
+        new_head = FREE_STACK_PACK(FREE_STACK_TAG(head) + 1, inumber);
+    } while (!__atomic_compare_exchange_n(&inode_free_stack, &head, new_head, 1,
+      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Pops a free inumber from the shared stack.
+ * Returns: the inumber, or FREE_INODE if the stack is empty
+ */
+static int free_stack_pop() {
+    uint64_t head = __atomic_load_n(&inode_free_stack, __ATOMIC_ACQUIRE), new_head;
+    int inumber;
+
+    do {
+        if ((inumber = FREE_STACK_TOP(head)) == FREE_INODE)
+            return FREE_INODE;
+
+        /* i-nodes are never released, so next_free is safe to read even if
+         * another thread pops this inumber first; the tag makes the CAS fail */
+        new_head = FREE_STACK_PACK(FREE_STACK_TAG(head) + 1, *inode_next_free(inumber));
+    } while (!__atomic_compare_exchange_n(&inode_free_stack, &head, new_head, 1,
+      __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    return inumber;
+}
+
+/*
+ * Empties the calling thread's cache if it was filled from an older table.
+ */
+static void inode_cache_check() {
+
+    if (inode_cache_instance != inode_table_instance) {
+        inode_cache_count = 0;
+        inode_cache_instance = inode_table_instance;
+    }
+}
+
+/*
+ * Gives the inumbers cached by the calling thread back to the shared
+ * stack, for other threads to use. Runs when a thread that took inumbers
+ * exits; init_fs calls it for the thread that created the root, which
+ * may never create another i-node.
+ */
+void inode_cache_flush() {
+
+    inode_cache_check();
+
+    /* the lowest inumber, handed out next, ends up on top */
+    for (int i = 0; i < inode_cache_count; i++)
+        free_stack_push(inode_cache[i]);
+
+    inode_cache_count = 0;
+}
+
+static void inode_cache_exit(void *arg) {
+    inode_cache_flush();
+}
+
+static void inode_cache_key_create() {
+    if (pthread_key_create(&inode_cache_key, inode_cache_exit) != 0) {
+        perror("Error: unable to create i-node cache key.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Refills the calling thread's cache, first from the shared stack and then
+ * by claiming a batch of never used inumbers from the top of the table.
+ * Returns: SUCCESS or FAIL if there are no free inumbers left
+ */
+static int inode_cache_refill() {
+    int inumber, top;
+
+    /* the thread gives its inumbers back when it exits */
+    if (pthread_getspecific(inode_cache_key) == NULL)
+        pthread_setspecific(inode_cache_key, inode_cache);
+
+    while (inode_cache_count < INODE_CACHE_BATCH && (inumber = free_stack_pop()) != FREE_INODE)
+        inode_cache[inode_cache_count++] = inumber;
+
+    if (inode_cache_count > 0)
+        return SUCCESS;
+
+    top = __atomic_load_n(&inode_table_top, __ATOMIC_RELAXED);
+    do {
+        if (top >= INODE_TABLE_SIZE)
+            return FAIL;
+    } while (!__atomic_compare_exchange_n(&inode_table_top, &top, top + INODE_CACHE_BATCH, 1,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    /* a batch never spans two segments since the segment size is a multiple of it */
+    if (inode_segment_get(top >> INODE_SEGMENT_SHIFT) == NULL) {
+        /* hand the batch back unless another one was claimed after it, so that it isn't lost */
+        int claimed = top + INODE_CACHE_BATCH;
+
+        __atomic_compare_exchange_n(&inode_table_top, &claimed, top, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        return FAIL;
+    }
+
+    /* hand out the lowest inumber first */
+    for (inumber = top + INODE_CACHE_BATCH - 1; inumber >= top; inumber--)
+        inode_cache[inode_cache_count++] = inumber;
+
+    return SUCCESS;
+}
+
+/*
+ * Returns a free inumber to the calling thread's cache, spilling half of
+ * the cache to the shared stack when it is full.
+ */
+static void inode_cache_release(int inumber) {
+
+    inode_cache_check();
+
+    if (inode_cache_count == INODE_CACHE_SIZE) {
+        while (inode_cache_count > INODE_CACHE_SIZE - INODE_CACHE_BATCH) {
+            int spilled = inode_cache[--inode_cache_count];
+            free_stack_push(spilled);
+        }
+    }
+
+    inode_cache[inode_cache_count++] = inumber;
+}
+
+/*
+ * Initializes the i-nodes table.
+ */
+void inode_table_init() {
+    for (int i = 0; i < INODE_SEGMENT_COUNT; i++)
+        inode_segments[i] = NULL;
+
+    inode_table_top = 0;
+    inode_free_stack = FREE_STACK_PACK(0, FREE_INODE);
+    __atomic_add_fetch(&inode_table_instance, 1, __ATOMIC_SEQ_CST);
+    pthread_once(&inode_cache_once, inode_cache_key_create);
+
+    pthread_rwlockattr_t attr;
+    if (pthread_rwlockattr_init(&attr) != 0 ||
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP) != 0 ||
+        pthread_rwlock_init(&namespace_print_rwlock, &attr) != 0) {
+        perror("Error: unable to initialize the namespace lock");
+        exit(EXIT_FAILURE);
+    }
+    pthread_rwlockattr_destroy(&attr);
+
+    arena_init();
+    slab_init();
+    epoch_init();
+    directory_init();
+    dcache_init();
+    pcache_init();
 }
 
 /*
@@ -29,63 +330,115 @@ void inode_table_init() {
 
 void inode_table_destroy() {
 
-    for (int i = 0; i < INODE_TABLE_SIZE; i++) {
-        if (inode_table[i].nodeType != T_NONE) {
-            /* as data is an union, the same pointer is used for both dirEntries and fileContents */
-            /* just release one of them */
-	    if (inode_table[i].data.dirEntries)
-            free(inode_table[i].data.dirEntries);
-        
-        if(pthread_rwlock_destroy(&inode_table[i].rwlock) != 0) {
-            perror("Error: unable to destroy rwlock.\n");
-            exit(EXIT_FAILURE);            
-        }
+    for (int s = 0; s < INODE_SEGMENT_COUNT; s++) {
+        inode_segment_t *segment = inode_segments[s];
+
+        if (segment == NULL)
+            continue;
+
+        for (int i = 0; i < INODE_SEGMENT_SIZE; i++) {
+            if (segment->types[i] == T_DIRECTORY)
+                directory_destroy(segment->data[i].dir);
+            else if (segment->types[i] == T_FILE)
+                file_destroy(segment->data[i].file);
+
+            if (segment->types[i] != T_NONE)
+                inode_set_name(s * INODE_SEGMENT_SIZE + i, NULL);
+
+            if(pthread_rwlock_destroy(&segment->locks[i].rwlock) != 0) {
+                perror("Error: unable to destroy rwlock.\n");
+                exit(EXIT_FAILURE);
+            }
         }
+
+        if (!arena_contains(segment))
+            free(segment);
+        slab_uncharge(sizeof(inode_segment_t), SLAB_INODES);
+        inode_segments[s] = NULL;
+    }
+
+    /* threads exiting from now on have nothing to give back */
+    __atomic_add_fetch(&inode_table_instance, 1, __ATOMIC_SEQ_CST);
+
+    pcache_destroy();
+    dcache_destroy();
+    epoch_destroy();
+    slab_destroy();
+    arena_destroy();
+
+    if (pthread_rwlock_destroy(&namespace_print_rwlock) != 0) {
+        perror("Error: unable to destroy the namespace lock");
+        exit(EXIT_FAILURE);
     }
 }
 
+/*
+ * Brackets a change to the entries or the type of an i-node, for the walks
+ * that read them without locking (see inode_read_begin). The i-node must be
+ * locked for write, or not reachable through any directory.
+ */
+static void inode_write_begin(int inumber) {
+    __atomic_add_fetch(inode_sequence(inumber), 1, __ATOMIC_SEQ_CST);
+
+    /* readers must see the odd sequence before any change */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void inode_write_end(int inumber) {
+    __atomic_add_fetch(inode_sequence(inumber), 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Initializes a free i-node as a new node of the given type.
+ * Input:
+ *  - inumber: identifier of the i-node, owned by the caller
+ *  - nType: the type of the node (file or directory)
+ *  - parent_inumber: identifier of the directory that will hold the node
+ */
+static void inode_init(int inumber, type nType, int parent_inumber) {
+    union Data *data = inode_data(inumber);
+
+    inode_write_begin(inumber);
+    inode_segment(inumber)->parents[INODE_INDEX(inumber)] = parent_inumber;
+    inode_segment(inumber)->names[INODE_INDEX(inumber)] = NULL;
+
+    if (nType == T_DIRECTORY) {
+        /* Initializes entry table */
+        data->dir = &inode_segment(inumber)->bodies[INODE_INDEX(inumber)].dir;
+        directory_create(data->dir);
+    }
+    else {
+        data->file = &inode_segment(inumber)->bodies[INODE_INDEX(inumber)].file;
+        file_create(data->file);
+    }
+
+    inode_segment(inumber)->types[INODE_INDEX(inumber)] = nType;
+    inode_write_end(inumber);
+}
+
 /*
  * Creates a new i-node in the table with the given information.
  * Input:
  *  - nType: the type of the node (file or directory)
+ *  - parent_inumber: identifier of the directory that will hold the node,
+ *    FREE_INODE for the root
  * Returns:
  *  inumber: identifier of the new i-node, if successfully created
  *     FAIL: if an error occurs
  */
 int inode_create(type nType, int parent_inumber) {
 
-    for (int inumber = 0; inumber < INODE_TABLE_SIZE; inumber++) {
-        
-        /* try to lock current inumber. only successful if not locked yet */
-        if (pthread_rwlock_trywrlock(&inode_table[inumber].rwlock) != 0){
-            continue;
-        }
+    int inumber;
 
-        if (inode_table[inumber].nodeType == T_NONE) {
-            
-            inode_table[inumber].nodeType = nType;
-        
-            if (nType == T_DIRECTORY) {
-                /* Initializes entry table */
-                inode_table[inumber].data.dirEntries = malloc(sizeof(DirEntry) * MAX_DIR_ENTRIES);
-                
-                for (int i = 0; i < MAX_DIR_ENTRIES; i++) {
-                    inode_table[inumber].data.dirEntries[i].inumber = FREE_INODE;
-
-                }
-            }
-            else {
-                inode_table[inumber].data.fileContents = NULL;
-            }
+    inode_cache_check();
 
-            unlock(inumber);
-            return inumber;
-        }
+    if (inode_cache_count == 0 && inode_cache_refill() == FAIL)
+        return FAIL;
 
-        unlock(inumber);
+    inumber = inode_cache[--inode_cache_count];
+    inode_init(inumber, nType, parent_inumber);
 
-    }
-    return FAIL;
+    return inumber;
 }
 
 /*
@@ -96,18 +449,35 @@ int inode_create(type nType, int parent_inumber) {
  */
 int inode_delete(int inumber) {
 
+    type nodeType = inode_type(inumber);
+    union Data *data;
 
-    if ((inumber < 0) || (inumber > INODE_TABLE_SIZE) || (inode_table[inumber].nodeType == T_NONE)) {
+    if (nodeType == T_NONE) {
         printf("inode_delete: invalid inumber\n");
 
         return FAIL;
     } 
 
-    inode_table[inumber].nodeType = T_NONE;
+    inode_write_begin(inumber);
+    inode_segment(inumber)->types[INODE_INDEX(inumber)] = T_NONE;
+
+    /* invalidate the handles issued for this i-node */
+    inode_segment(inumber)->generations[INODE_INDEX(inumber)]++;
 
-    /* see inode_table_destroy function */
-    if (inode_table[inumber].data.dirEntries)
-        free(inode_table[inumber].data.dirEntries);
+    inode_segment(inumber)->parents[INODE_INDEX(inumber)] = FREE_INODE;
+    inode_set_name(inumber, NULL);
+
+    /* the directory blocks and file chunks go back to this thread's magazines, no malloc lock is taken */
+    data = inode_data(inumber);
+    if (nodeType == T_DIRECTORY)
+        directory_destroy(data->dir);
+    else
+        file_destroy(data->file);
+    data->dir = NULL;
+    inode_write_end(inumber);
+
+    /* recycle the inumber right away */
+    inode_cache_release(inumber);
 
     
     return SUCCESS;
@@ -124,56 +494,351 @@ int inode_delete(int inumber) {
  */
 int inode_get(int inumber, type *nType, union Data *data) {
 
-    if ((inumber < 0) || (inumber > INODE_TABLE_SIZE) || (inode_table[inumber].nodeType == T_NONE)) {
+    type nodeType = inode_type(inumber);
+
+    if (nodeType == T_NONE) {
         printf("inode_get: invalid inumber %d\n", inumber);
 
         return FAIL;
     }
 
     if (nType)
-        *nType = inode_table[inumber].nodeType;
+        *nType = nodeType;
 
     if (data)
-        *data = inode_table[inumber].data;
+        *data = *inode_data(inumber);
+
+
+    return SUCCESS;
+}
+
+/*
+ * Returns the generation of an i-node. Together with the inumber it forms
+ * a handle that stops being valid once the i-node is deleted.
+ * Input:
+ *  - inumber: identifier of the i-node
+ * Returns: the generation, or 0 if the inumber is invalid
+ */
+unsigned int inode_get_generation(int inumber) {
+
+    if (inode_segment(inumber) == NULL)
+        return 0;
+
+    return inode_segment(inumber)->generations[INODE_INDEX(inumber)];
+}
 
+/*
+ * Checks if a handle still refers to the i-node it was issued for.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - generation: generation of the i-node when the handle was issued
+ * Returns: SUCCESS or FAIL if the i-node was deleted since
+ */
+int inode_check_generation(int inumber, unsigned int generation) {
+
+    if (inode_type(inumber) == T_NONE)
+        return FAIL;
+
+    if (inode_segment(inumber)->generations[INODE_INDEX(inumber)] != generation)
+        return FAIL;
 
     return SUCCESS;
 }
 
+/*
+ * Returns the inumber of the directory holding an i-node, FREE_INODE for
+ * the root or an invalid inumber. It is kept up to date by move, under the
+ * locks of both parents.
+ */
+int inode_get_parent(int inumber) {
+
+    if (inode_type(inumber) == T_NONE)
+        return FREE_INODE;
+
+    return inode_segment(inumber)->parents[INODE_INDEX(inumber)];
+}
+
+void inode_set_parent(int inumber, int parent_inumber) {
+    inode_segment(inumber)->parents[INODE_INDEX(inumber)] = parent_inumber;
+}
+
+/*
+ * Checks if an i-node is an ancestor of another (or the i-node itself) by
+ * following the parent inumbers, in O(depth). The caller must keep the
+ * ancestors of inumber from being moved, by holding the rename lock.
+ * Input:
+ *  - ancestor_inumber: identifier of the possible ancestor
+ *  - inumber: identifier of the i-node to start at
+ * Returns: SUCCESS if it is an ancestor, FAIL otherwise
+ */
+int inode_is_ancestor(int ancestor_inumber, int inumber) {
+
+    for (; inumber != FREE_INODE; inumber = inode_get_parent(inumber)) {
+        if (inumber == ancestor_inumber)
+            return SUCCESS;
+    }
+
+    return FAIL;
+}
+
+/*
+ * Sets the name of an i-node in its parent directory. The name is only
+ * changed with the parent locked for write, and read with it locked.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - name: the new name, or NULL to just free the current one
+ * Returns: SUCCESS or FAIL if out of memory
+ */
+int inode_set_name(int inumber, char *name) {
+    char **current = &inode_segment(inumber)->names[INODE_INDEX(inumber)];
+    char *copy = NULL, *old;
+
+    if (name != NULL) {
+        if ((copy = slab_alloc(strlen(name) + 1, SLAB_NAMES)) == NULL)
+            return FAIL;
+        strcpy(copy, name);
+    }
+
+    old = *current;
+    *current = copy;
+
+    if (old != NULL)
+        epoch_retire(old, strlen(old) + 1, SLAB_NAMES);
+
+    return SUCCESS;
+}
+
+/*
+ * Copies the name of an i-node in its parent directory, which must be
+ * locked.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - name: buffer of MAX_FILE_NAME characters to store the name
+ * Returns: SUCCESS or FAIL if the i-node has no name (the root)
+ */
+int inode_get_name(int inumber, char *name) {
+    char *current;
+
+    if (inode_type(inumber) == T_NONE)
+        return FAIL;
+
+    if ((current = inode_segment(inumber)->names[INODE_INDEX(inumber)]) == NULL)
+        return FAIL;
+
+    strcpy(name, current);
+    return SUCCESS;
+}
+
+/*
+ * Brackets the changes a move makes to the parents and names of i-nodes.
+ */
+void namespace_move_begin() {
+    __atomic_add_fetch(&namespace_moves_started, 1, __ATOMIC_SEQ_CST);
+}
+
+void namespace_move_end() {
+    __atomic_add_fetch(&namespace_moves_finished, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Keeps every other move from running until namespace_rename_unlock. It is
+ * taken before any i-node lock.
+ */
+void namespace_rename_lock() {
+    if (pthread_mutex_lock(&namespace_rename_mutex) != 0) {
+        perror("Error: unable to lock the namespace");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void namespace_rename_unlock() {
+    if (pthread_mutex_unlock(&namespace_rename_mutex) != 0) {
+        perror("Error: unable to unlock the namespace");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Brackets an operation that adds, removes or moves a name, keeping
+ * printFS from running meanwhile. Taken before every other lock, and
+ * never nested.
+ */
+void namespace_change_begin() {
+    if (pthread_rwlock_rdlock(&namespace_print_rwlock) != 0) {
+        perror("Error: unable to lock the namespace for a change");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void namespace_change_end() {
+    if (pthread_rwlock_unlock(&namespace_print_rwlock) != 0) {
+        perror("Error: unable to unlock the namespace");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Waits for the running changes to the namespace to finish, and keeps new
+ * ones from starting until namespace_print_end.
+ */
+void namespace_print_begin() {
+    if (pthread_rwlock_wrlock(&namespace_print_rwlock) != 0) {
+        perror("Error: unable to lock the namespace for printing");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void namespace_print_end() {
+    if (pthread_rwlock_unlock(&namespace_print_rwlock) != 0) {
+        perror("Error: unable to unlock the namespace");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Starts reading parents and names without holding the locks of all the
+ * i-nodes involved, waiting for the moves in progress to end.
+ * Returns: a value for namespace_read_retry
+ */
+unsigned long namespace_read_begin() {
+    unsigned long started;
+
+    while ((started = __atomic_load_n(&namespace_moves_started, __ATOMIC_SEQ_CST)) !=
+           __atomic_load_n(&namespace_moves_finished, __ATOMIC_SEQ_CST))
+        sched_yield();
+
+    return started;
+}
+
+/*
+ * Checks if what was read since namespace_read_begin may mix the states
+ * before and after a move.
+ * Returns: SUCCESS if it must be read again, FAIL otherwise
+ */
+int namespace_read_retry(unsigned long moves) {
+    return __atomic_load_n(&namespace_moves_started, __ATOMIC_SEQ_CST) != moves ? SUCCESS : FAIL;
+}
+
+/*
+ * Returns the namespace version, see namespace_version.
+ */
+unsigned long namespace_get_version() {
+    return __atomic_load_n(&namespace_version, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Starts reading the entries and type of an i-node without locking it,
+ * waiting for a change in progress to end. Anything read is only known to
+ * be consistent once inode_read_retry says so.
+ * Input:
+ *  - inumber: identifier of the i-node
+ * Returns: a value for inode_read_retry
+ */
+unsigned int inode_read_begin(int inumber) {
+    unsigned int sequence;
+
+    while ((sequence = __atomic_load_n(inode_sequence(inumber), __ATOMIC_ACQUIRE)) & 1)
+        sched_yield();
+
+    return sequence;
+}
+
+/*
+ * Checks if the entries or type of an i-node changed since inode_read_begin.
+ * Returns: SUCCESS if they must be read again, FAIL otherwise
+ */
+int inode_read_retry(int inumber, unsigned int sequence) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(inode_sequence(inumber), __ATOMIC_RELAXED) != sequence ? SUCCESS : FAIL;
+}
+
+/*
+ * inode_read_retry for the readers that take a callback, such as
+ * directory_find_unlocked.
+ * Input:
+ *  - read: pointer to an inode_read_t
+ * Returns: nonzero if the i-node must be read again
+ */
+int inode_read_changed(void *read) {
+    inode_read_t *inode = read;
+
+    return inode_read_retry(inode->inumber, inode->sequence) == SUCCESS;
+}
+
+/*
+ * Returns the entries of a directory, or NULL if the i-node isn't one.
+ * Without the i-node locked, the result must be checked with
+ * inode_read_retry.
+ */
+Directory *inode_get_dir(int inumber) {
+
+    if (inode_type(inumber) != T_DIRECTORY)
+        return NULL;
+
+    return &inode_segment(inumber)->bodies[INODE_INDEX(inumber)].dir;
+}
+
+/*
+ * Replaces the contents of a file.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - fileContents: the new contents
+ *  - len: number of bytes of the new contents
+ * Returns: SUCCESS or FAIL
+ */
+int inode_set_file(int inumber, char *fileContents, int len) {
+
+    if (inode_type(inumber) != T_FILE) {
+        printf("inode_set_file: can only set the contents of files\n");
+        return FAIL;
+    }
+
+    /* published as one version, readers never see the file empty */
+    if (file_replace(inode_data(inumber)->file, fileContents, len) == FAIL)
+        return FAIL;
+
+    return SUCCESS;
+}
 
 /*
  * Resets an entry for a directory.
  * Input:
  *  - inumber: identifier of the i-node
  *  - sub_inumber: identifier of the sub i-node entry
+ *  - sub_name: name of the sub i-node entry
  * Returns: SUCCESS or FAIL
  */
-int dir_reset_entry(int inumber, int sub_inumber) {
+int dir_reset_entry(int inumber, int sub_inumber, char *sub_name) {
+
+    type nodeType = inode_type(inumber);
 
-    if ((inumber < 0) || (inumber > INODE_TABLE_SIZE) || (inode_table[inumber].nodeType == T_NONE)) {
+    if (nodeType == T_NONE) {
         printf("inode_reset_entry: invalid inumber\n");
         return FAIL;
     }
 
-    if (inode_table[inumber].nodeType != T_DIRECTORY) {
+    if (nodeType != T_DIRECTORY) {
         printf("inode_reset_entry: can only reset entry to directories\n");
         return FAIL;
     }
 
-    if ((sub_inumber < FREE_INODE) || (sub_inumber > INODE_TABLE_SIZE) || (inode_table[sub_inumber].nodeType == T_NONE)) {
+    if (inode_type(sub_inumber) == T_NONE) {
         printf("inode_reset_entry: invalid entry inumber\n");
         return FAIL;
     }
     
-    for (int i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (inode_table[inumber].data.dirEntries[i].inumber == sub_inumber) {
-            inode_table[inumber].data.dirEntries[i].inumber = FREE_INODE;
-            inode_table[inumber].data.dirEntries[i].name[0] = '\0';
-    
-            return SUCCESS;
-        }
+    inode_write_begin(inumber);
+
+    if (directory_remove(inode_data(inumber)->dir, sub_inumber, sub_name) == FAIL) {
+        inode_write_end(inumber);
+        return FAIL;
     }
-    return FAIL;
+
+    dcache_remove(inumber, sub_name);
+    inode_write_end(inumber);
+    __atomic_add_fetch(&namespace_version, 1, __ATOMIC_SEQ_CST);
+    return SUCCESS;
 }
 
 
@@ -183,21 +848,23 @@ int dir_reset_entry(int inumber, int sub_inumber) {
  *  - inumber: identifier of the i-node
  *  - sub_inumber: identifier of the sub i-node entry
  *  - sub_name: name of the sub i-node entry 
- * Returns: SUCCESS or FAIL
+ * Returns: SUCCESS, FAIL or TECNICOFS_ERROR_NO_MEMORY
  */
 int dir_add_entry(int inumber, int sub_inumber, char *sub_name) {
 
-    if ((inumber < 0) || (inumber > INODE_TABLE_SIZE) || (inode_table[inumber].nodeType == T_NONE)) {
+    type nodeType = inode_type(inumber);
+
+    if (nodeType == T_NONE) {
         printf("inode_add_entry: invalid inumber\n");
         return FAIL;
     }
 
-    if (inode_table[inumber].nodeType != T_DIRECTORY) {
+    if (nodeType != T_DIRECTORY) {
         printf("inode_add_entry: can only add entry to directories\n");
         return FAIL;
     }
 
-    if ((sub_inumber < 0) || (sub_inumber > INODE_TABLE_SIZE) || (inode_table[sub_inumber].nodeType == T_NONE)) {
+    if (inode_type(sub_inumber) == T_NONE) {
         printf("inode_add_entry: invalid entry inumber\n");
         return FAIL;
     }
@@ -209,43 +876,52 @@ int dir_add_entry(int inumber, int sub_inumber, char *sub_name) {
     }
     
     
-    for (int i = 0; i < MAX_DIR_ENTRIES; i++) {
+    inode_write_begin(inumber);
 
-        if (inode_table[inumber].data.dirEntries[i].inumber == FREE_INODE) {
-            inode_table[inumber].data.dirEntries[i].inumber = sub_inumber;
-            strcpy(inode_table[inumber].data.dirEntries[i].name, sub_name);
-            return SUCCESS;
-        }
+    if (directory_add(inode_data(inumber)->dir, sub_inumber, sub_name) == FAIL) {
+        inode_write_end(inumber);
+        return TECNICOFS_ERROR_NO_MEMORY;
     }
 
-    return FAIL;
+    dcache_add(inumber, inode_get_generation(inumber), sub_name,
+               sub_inumber, inode_get_generation(sub_inumber));
+    inode_write_end(inumber);
+    return SUCCESS;
 }
 
 
 /*
- * Prints the i-nodes table.
+ * Prints a directory and everything below it. Each directory stays read
+ * locked until its subtree is printed. The caller must hold the namespace
+ * for printing (see namespace_print_begin), so that no name is added,
+ * removed or moved anywhere in the tree during the walk.
  * Input:
- *  - inumber: identifier of the i-node
+ *  - inumber: identifier of the directory, read locked by the caller and
+ *    unlocked on return
  *  - name: pointer to the name of current file/dir
  */
 void inode_print_tree(FILE *fp, int inumber, char *name) {
-    if (inode_table[inumber].nodeType == T_FILE) {
-        fprintf(fp, "%s\n", name);
-        return;
-    }
-
-    if (inode_table[inumber].nodeType == T_DIRECTORY) {
-        fprintf(fp, "%s\n", name);
-        for (int i = 0; i < MAX_DIR_ENTRIES; i++) {
-            if (inode_table[inumber].data.dirEntries[i].inumber != FREE_INODE) {
-                char path[MAX_FILE_NAME];
-                if (snprintf(path, sizeof(path), "%s/%s", name, inode_table[inumber].data.dirEntries[i].name) > sizeof(path)) {
-                    fprintf(stderr, "truncation when building full path\n");
-                }
-                inode_print_tree(fp, inode_table[inumber].data.dirEntries[i].inumber, path);
-            }
+    char sub_name[MAX_FILE_NAME] = "";
+    int sub_inumber;
+
+    fprintf(fp, "%s\n", name);
+
+    while ((sub_inumber = directory_next(inode_data(inumber)->dir, sub_name)) != FREE_INODE) {
+        char path[MAX_FILE_NAME];
+        if (snprintf(path, sizeof(path), "%s/%s", name, sub_name) > sizeof(path)) {
+            fprintf(stderr, "truncation when building full path\n");
+        }
+
+        if (inode_type(sub_inumber) != T_DIRECTORY) {
+            fprintf(fp, "%s\n", path);
+            continue;
         }
+
+        lock(sub_inumber, READ);
+        inode_print_tree(fp, sub_inumber, path);
     }
+
+    unlock(inumber);
 }
 
 /* Locks an inode given an inumber
@@ -256,13 +932,13 @@ void inode_print_tree(FILE *fp, int inumber, char *name) {
 void lock(int inode_number, char rw) {
     
     if (rw == WRITE || rw == MOVE) {
-        if(pthread_rwlock_wrlock(&(inode_table[inode_number].rwlock)) != 0) {
+        if(pthread_rwlock_wrlock(inode_rwlock(inode_number)) != 0) {
             perror("Error: unable to lock for write");
             exit(EXIT_FAILURE);
         }
     }
     else if (rw == READ) {
-        if(pthread_rwlock_rdlock(&(inode_table[inode_number].rwlock)) != 0) {
+        if(pthread_rwlock_rdlock(inode_rwlock(inode_number)) != 0) {
             perror("Error: unable to lock for read");
             exit(EXIT_FAILURE);
         }
@@ -270,21 +946,29 @@ void lock(int inode_number, char rw) {
     }
 }
 
-/*
-* Unlocks the inodes corresponding to the inumbers on a array
+/* Locks an inode if that can be done without waiting
 * Input:
-*   - locked_inumbers: array with the inumbers of the locked inodes
+*   - inode_number: number of the inode we want to lock
+*   - rw: flag used to determine if it is a read or a write lock
+* Returns: SUCCESS or FAIL if it is locked by another thread
 */
-void unlock_array(int locked_inumbers[]) { 
-    int i=0;
+int trylock(int inode_number, char rw) {
+    int result;
 
-    while (locked_inumbers[i] != -1)
-        i++;
-        
-    i--;
+    if (rw == WRITE || rw == MOVE)
+        result = pthread_rwlock_trywrlock(inode_rwlock(inode_number));
+    else
+        result = pthread_rwlock_tryrdlock(inode_rwlock(inode_number));
 
-    for (; i >= 0; i--)
-        unlock(locked_inumbers[i]);
+    if (result == 0)
+        return SUCCESS;
+
+    if (result != EBUSY) {
+        perror("Error: unable to lock");
+        exit(EXIT_FAILURE);
+    }
+
+    return FAIL;
 }
 
 /*
@@ -294,7 +978,7 @@ void unlock_array(int locked_inumbers[]) {
 */
 void unlock(int inode_number) {
 
-    if(pthread_rwlock_unlock(&(inode_table[inode_number].rwlock)) != 0) {
+    if(pthread_rwlock_unlock(inode_rwlock(inode_number)) != 0) {
         perror("Error: unable to unlock");
         exit(EXIT_FAILURE);
     }
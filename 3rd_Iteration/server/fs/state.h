@@ -4,14 +4,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include "slab.h"
+#include "arena.h"
+#include "directory.h"
+#include "dcache.h"
+#include "pcache.h"
+#include "epoch.h"
+#include "context.h"
+#include "file.h"
 #include "../tecnicofs-api-constants.h"
 
 /* FS root inode number */
 #define FS_ROOT 0
 
 #define FREE_INODE -1
-#define INODE_TABLE_SIZE 50
-#define MAX_DIR_ENTRIES 20
+
+/*
+ * The i-node table is split into fixed-size segments that are allocated on
+ * demand. Segments are never moved or released while the fs is running, so
+ * an i-node keeps its address for the whole lifetime of the table.
+ */
+#define INODE_SEGMENT_SHIFT 12
+#define INODE_SEGMENT_SIZE (1 << INODE_SEGMENT_SHIFT)
+#define INODE_SEGMENT_COUNT (1 << 14)
+#define INODE_TABLE_SIZE (INODE_SEGMENT_SIZE * INODE_SEGMENT_COUNT)
+
+/*
+ * Free inumbers are kept in a per-thread cache backed by a shared lock-free
+ * stack. Threads move INODE_CACHE_BATCH inumbers at a time between the two.
+ */
+#define INODE_CACHE_SIZE 64
+#define INODE_CACHE_BATCH 32
 
 #define SUCCESS 0
 #define FAIL -1
@@ -28,43 +51,90 @@
 #define LOOKUP 0
 
 /*
- * Contains the name of the entry and respective i-number
- */
-typedef struct dirEntry {
-	char name[MAX_FILE_NAME];
-	int inumber;
-} DirEntry;
-
-/*
- * Data is either text (file) or entries (DirEntry)
+ * Data is either contents (FileData) or entries (Directory), both kept in
+ * the i-node's segment
  */
 union Data {
-	char *fileContents; /* for files */
-	DirEntry *dirEntries; /* for directories */
+	FileData *file; /* for files */
+	Directory *dir; /* for directories */
 };
 
+typedef union inode_body {
+	FileData file;
+	Directory dir;
+} inode_body_t;
+
 /*
- * I-node definition
+ * Cache line size, used to keep each i-node lock on a line of its own
  */
-typedef struct inode_t {
+#define CACHE_LINE_SIZE 64
+
+typedef struct inode_lock {
 	pthread_rwlock_t rwlock;
-	type nodeType;
-	union Data data;
-    /* more i-node attributes will be added in future exercises */
-} inode_t;
+} __attribute__((aligned(CACHE_LINE_SIZE))) inode_lock_t;
+
+/*
+ * I-node table segment, stored as a struct of arrays: the fields read on
+ * every step of a path walk (type and data) are packed densely, while the
+ * locks are padded so that lock traffic on one i-node does not invalidate
+ * the cache lines of its neighbours.
+ */
+typedef struct inode_segment {
+	unsigned char types[INODE_SEGMENT_SIZE];
+	union Data data[INODE_SEGMENT_SIZE];
+	unsigned int generations[INODE_SEGMENT_SIZE]; /* bumped every time the i-node is deleted */
+	unsigned int sequences[INODE_SEGMENT_SIZE]; /* odd while the entries or type change, see inode_read_begin */
+	int parents[INODE_SEGMENT_SIZE]; /* directory holding the i-node, FREE_INODE for the root */
+	char *names[INODE_SEGMENT_SIZE]; /* name in that directory, NULL for the root */
+	int next_free[INODE_SEGMENT_SIZE]; /* next inumber in the shared free stack */
+	inode_body_t bodies[INODE_SEGMENT_SIZE]; /* small directories and files need no other memory */
+	inode_lock_t locks[INODE_SEGMENT_SIZE];
+} inode_segment_t;
+
+/*
+ * An i-node read without locking: its inumber and the sequence
+ * inode_read_begin returned, for inode_read_changed.
+ */
+typedef struct inode_read {
+	int inumber;
+	unsigned int sequence;
+} inode_read_t;
 
 void insert_delay(int cycles);
 void inode_table_init();
 void inode_table_destroy();
 int inode_create(type nType, int parent_inumber);
+void inode_cache_flush();
 int inode_delete(int inumber);
 int inode_get(int inumber, type *nType, union Data *data);
+unsigned int inode_get_generation(int inumber);
+int inode_check_generation(int inumber, unsigned int generation);
+int inode_get_parent(int inumber);
+void inode_set_parent(int inumber, int parent_inumber);
+int inode_is_ancestor(int ancestor_inumber, int inumber);
+int inode_set_name(int inumber, char *name);
+int inode_get_name(int inumber, char *name);
+void namespace_move_begin();
+void namespace_move_end();
+void namespace_rename_lock();
+void namespace_rename_unlock();
+void namespace_change_begin();
+void namespace_change_end();
+void namespace_print_begin();
+void namespace_print_end();
+unsigned long namespace_read_begin();
+int namespace_read_retry(unsigned long moves);
+unsigned long namespace_get_version();
+unsigned int inode_read_begin(int inumber);
+int inode_read_retry(int inumber, unsigned int sequence);
+int inode_read_changed(void *read);
+Directory *inode_get_dir(int inumber);
 int inode_set_file(int inumber, char *fileContents, int len);
-int dir_reset_entry(int inumber, int sub_inumber);
+int dir_reset_entry(int inumber, int sub_inumber, char *sub_name);
 int dir_add_entry(int inumber, int sub_inumber, char *sub_name);
 void inode_print_tree(FILE *fp, int inumber, char *name);
 void lock(int inode_number, char rw);
-void unlock_array(int locked_inumbers[]);
+int trylock(int inode_number, char rw);
 void unlock(int inode_number);
 
 #endif /* INODES_H */
@@ -14,27 +14,88 @@
 #include <sys/stat.h>
 
 #define MAX_INPUT_SIZE 100
-#define OUT_BUFFER_SIZE 8
+#define OUT_BUFFER_SIZE 32
+#define MAX_COMMAND_SIZE (MAX_INPUT_SIZE + MAX_DATA_SIZE)
 
 int numberThreads = 0, sockfd = 0;
+char *socketName;
 
 /*
- * Validates the arguments given in the shell
+ * Parses a memory size given as a number of bytes, optionally followed by
+ * K, M or G.
+ * Returns: the size, or 0 if it isn't valid
+ */
+size_t parse_memory_size(char *arg)
+{
+    char *unit;
+    long size = strtol(arg, &unit, 10);
+
+    if (size <= 0 || unit == arg)
+        return 0;
+
+    switch (toupper(*unit))
+    {
+    case '\0':
+        return size;
+    case 'K':
+        return (size_t)size << 10;
+    case 'M':
+        return (size_t)size << 20;
+    case 'G':
+        return (size_t)size << 30;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Validates the arguments given in the shell:
+ * [-m max_memory] [-a arena_size] number_of_threads socket_name
  */
 void validate_arguments(int argc, char *argv[])
 {
+    size_t limit, size;
+    int option;
+
+    while ((option = getopt(argc, argv, "m:a:")) != -1)
+    {
+        switch (option)
+        {
+        case 'm': /* memory limit of the fs blocks in use and caches (about 18M), not of the process */
+            if ((limit = parse_memory_size(optarg)) == 0)
+            {
+                fprintf(stderr, "Error: memory limit not valid.\n");
+                exit(EXIT_FAILURE);
+            }
+            slab_set_limit(limit);
+            break;
+        case 'a': /* size of the huge-page arena for i-nodes and slab pages */
+            if ((size = parse_memory_size(optarg)) == 0)
+            {
+                fprintf(stderr, "Error: arena size not valid.\n");
+                exit(EXIT_FAILURE);
+            }
+            arena_set_size(size);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-m max_memory] [-a arena_size] number_of_threads socket_name\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    if (argc != 3)
+    if (argc - optind != 2)
     {
         perror("Error: number of arguments not valid.\n");
         exit(EXIT_FAILURE);
     }
 
-    if ((numberThreads = atoi(argv[1])) < 1)
+    if ((numberThreads = atoi(argv[optind])) < 1)
     { /* validate number of threads */
         perror("Error: number of threads not valid.\n");
         exit(EXIT_FAILURE);
     }
+
+    socketName = argv[optind + 1];
 }
 
 /*
@@ -68,7 +129,7 @@ void recieveCommand(char *command, struct sockaddr_un *client_addr)
 {
     int c;
     socklen_t addrlen;
-    char in_buffer[MAX_INPUT_SIZE];
+    char in_buffer[MAX_COMMAND_SIZE];
 
     addrlen = sizeof(struct sockaddr_un);
 
@@ -104,9 +165,73 @@ void sendCommandResult(int result, struct sockaddr_un *client_addr)
     sendto(sockfd, out_buffer, c + 1, 0, (struct sockaddr *)client_addr, addrlen);
 }
 
+/*
+ * Sends a directory handle to a client.
+ * Input:
+ *  - inumber: inumber of the directory
+ *  - generation: generation of the directory
+ *  - client_addr: client socket address
+ */
+void sendHandleResult(int inumber, unsigned int generation, struct sockaddr_un *client_addr)
+{
+
+    char out_buffer[OUT_BUFFER_SIZE];
+    int c, addrlen;
+
+    addrlen = sizeof(struct sockaddr_un);
+
+    c = sprintf(out_buffer, "%d %u", inumber, generation);
+
+    sendto(sockfd, out_buffer, c + 1, 0, (struct sockaddr *)client_addr, addrlen);
+}
+
+/*
+ * Sends a result to a client, followed by that many bytes: the bytes read
+ * from a file, or a path.
+ * Input:
+ *  - result: number of bytes, or the error
+ *  - data: the bytes
+ *  - client_addr: client socket address
+ */
+void sendDataResult(int result, char *data, struct sockaddr_un *client_addr)
+{
+
+    char out_buffer[OUT_BUFFER_SIZE + MAX_DATA_SIZE];
+    int c, addrlen;
+
+    addrlen = sizeof(struct sockaddr_un);
+
+    c = sprintf(out_buffer, "%d ", result);
+
+    if (result > 0)
+    {
+        memcpy(out_buffer + c, data, result);
+        c += result;
+    }
+    out_buffer[c] = '\0';
+
+    sendto(sockfd, out_buffer, c + 1, 0, (struct sockaddr *)client_addr, addrlen);
+}
+
+/*
+ * Parses a directory handle sent by a client as "inumber:generation".
+ * Returns: SUCCESS or FAIL
+ */
+int parseHandle(char *arg, int *inumber, unsigned int *generation)
+{
+    if (sscanf(arg, "%d:%u", inumber, generation) != 2)
+    {
+        fprintf(stderr, "Error: invalid handle %s\n", arg);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
 void *applyCommands()
 {
-    char command[MAX_INPUT_SIZE];
+    char command[MAX_COMMAND_SIZE];
+    char data[MAX_DATA_SIZE];
     struct sockaddr_un client_addr;
 
     while (1)
@@ -118,10 +243,13 @@ void *applyCommands()
             continue;
 
         char token;
-        char arg1[MAX_INPUT_SIZE];
-        char arg2[MAX_INPUT_SIZE];
-        int result;
-        int numTokens = sscanf(command, "%c %s %s", &token, arg1, arg2);
+        char arg1[MAX_COMMAND_SIZE];
+        char arg2[MAX_COMMAND_SIZE];
+        char arg3[MAX_COMMAND_SIZE];
+        int result, inumber, start = -1, len;
+        long offset;
+        unsigned int generation;
+        int numTokens = sscanf(command, "%c %s %s %s", &token, arg1, arg2, arg3);
         if (numTokens < 2)
         {
             fprintf(stderr, "Error: invalid command in Queue\n");
@@ -165,6 +293,101 @@ void *applyCommands()
         case 'p':
             result = printFS(arg1);
             break;
+        case 's':
+            result = printStats(arg1);
+            break;
+        case 'o':
+            result = open_dir(arg1, &generation);
+            if (result >= 0)
+            {
+                printf("Open directory: %s\n", arg1);
+                sendHandleResult(result, generation, &client_addr);
+                continue;
+            }
+            break;
+        case 'L':
+            if (numTokens < 3 || parseHandle(arg1, &inumber, &generation) == FAIL)
+            {
+                result = FAIL;
+                break;
+            }
+            result = lookup_at(inumber, generation, arg2);
+            if (result >= 0)
+                printf("Search at %s: %s found\n", arg1, arg2);
+            else
+                printf("Search at %s: %s not found\n", arg1, arg2);
+            break;
+        case 'C':
+            if (numTokens < 4 || parseHandle(arg1, &inumber, &generation) == FAIL)
+            {
+                result = FAIL;
+                break;
+            }
+            switch (arg3[0])
+            {
+            case 'f':
+                printf("Create file at %s: %s\n", arg1, arg2);
+                result = create_at(inumber, generation, arg2, T_FILE);
+                break;
+            case 'd':
+                printf("Create directory at %s: %s\n", arg1, arg2);
+                result = create_at(inumber, generation, arg2, T_DIRECTORY);
+                break;
+            default:
+                perror("Error: invalid create command\n");
+                result = FAIL;
+                break;
+            }
+            break;
+        case 'w':
+            /* the data is the rest of the command, after the offset and one space */
+            if (sscanf(command, "%*c %s %ld%n", arg1, &offset, &start) < 2 || start < 0)
+            {
+                result = FAIL;
+                break;
+            }
+            start += command[start] == ' ';
+            printf("Write: %s\n", arg1);
+            result = write_file(arg1, offset, command + start, strlen(command + start));
+            break;
+        case 'a':
+            if (sscanf(command, "%*c %s%n", arg1, &start) < 1 || start < 0)
+            {
+                result = FAIL;
+                break;
+            }
+            start += command[start] == ' ';
+            printf("Append: %s\n", arg1);
+            result = append_file(arg1, command + start, strlen(command + start));
+            break;
+        case 'r':
+            if (sscanf(command, "%*c %s %ld %d", arg1, &offset, &len) < 3)
+            {
+                result = FAIL;
+                break;
+            }
+            printf("Read: %s\n", arg1);
+            result = read_file(arg1, offset, data, len < MAX_DATA_SIZE ? len : MAX_DATA_SIZE);
+            sendDataResult(result, data, &client_addr);
+            continue;
+        case 'n':
+            if (sscanf(arg1, "%d", &inumber) != 1)
+            {
+                result = FAIL;
+                break;
+            }
+            result = get_path(inumber, data);
+            sendDataResult(result, data, &client_addr);
+            continue;
+        case 't':
+            if (sscanf(command, "%*c %s %ld", arg1, &offset) < 2)
+            {
+                result = FAIL;
+                break;
+            }
+            printf("Truncate: %s\n", arg1);
+            result = truncate_file(arg1, offset);
+            break;
         default: /* error */
             perror("Error: invalid command\n");
             result = FAIL;
@@ -214,13 +437,13 @@ int main(int argc, char *argv[])
 {
 
     struct timeval begin, end;
-    pthread_t tid[numberThreads];
-    char *socketName;
     struct sockaddr_un server_addr;
     socklen_t addrlen;
 
     validate_arguments(argc, argv);
 
+    pthread_t tid[numberThreads];
+
     /* create socket without name and check for error */
     if ((sockfd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
     {
@@ -228,7 +451,6 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    socketName = argv[2];
     unlink(socketName);
 
     /* bind socket with desired socketName given and check for error */
@@ -4,6 +4,8 @@
 
 #define MAX_FILE_NAME 100
 #define MAX_INPUT_SIZE 100
+/* Maximum number of bytes moved by one read or write */
+#define MAX_DATA_SIZE 1024
 
 
 typedef enum permission { NONE, WRITE, READ, RW } permission;
@@ -31,5 +33,9 @@ typedef enum type { T_FILE, T_DIRECTORY, T_NONE } type;
 #define TECNICOFS_ERROR_INVALID_MODE -10
 /* Generic error */
 #define TECNICOFS_ERROR_OTHER -11
+/* Handle refers to an i-node that was deleted */
+#define TECNICOFS_ERROR_STALE_HANDLE -12
+/* The server reached its memory limit */
+#define TECNICOFS_ERROR_NO_MEMORY -13
 
 #endif /* TECNICOFS_API_CONSTANTS_H */
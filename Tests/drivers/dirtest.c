@@ -0,0 +1,153 @@
+/*
+ * Directory test: fills a directory past DIR_TREE_THRESHOLD so it becomes
+ * a B+ tree of several levels, empties a range of it so whole leaves go
+ * away, and then removes names until it goes back to an array, inline
+ * entries and empty. Checks the kind, the names found and listed, that no
+ * tree node is left empty, and that every block is given back at the end.
+ *
+ * Usage: dirtest
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fs/operations.h"
+
+#define NAMES 500
+
+static int failures = 0;
+
+static void check(int condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "dirtest: %s\n", what);
+        failures++;
+    }
+}
+
+static void name_of(int i, char *name) {
+    sprintf(name, "f%04d", i);
+}
+
+static long directory_bytes() {
+    return slab_category_bytes(SLAB_DIRECTORIES) + slab_category_bytes(SLAB_NAMES);
+}
+
+/*
+ * Counts the nodes of a subtree and the ones without keys.
+ */
+static void count_nodes(DirNode *node, int *nodes, int *empty) {
+    (*nodes)++;
+    if (node->count == 0)
+        (*empty)++;
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++)
+            count_nodes(node->u.children[i], nodes, empty);
+    }
+}
+
+/*
+ * Checks that exactly the names in [0, NAMES) not in [gone_from, gone_to)
+ * are found and listed, in order.
+ */
+static void check_names(Directory *dir, int gone_from, int gone_to) {
+    char name[MAX_FILE_NAME], listed[MAX_FILE_NAME] = "";
+    int expected = 0;
+
+    for (int i = 0; i < NAMES; i++) {
+        int present = i < gone_from || i >= gone_to;
+
+        name_of(i, name);
+        if ((directory_find(dir, name) == i + 1) != present) {
+            check(0, present ? "name not found" : "removed name found");
+            return;
+        }
+    }
+
+    while (directory_next(dir, listed) != FREE_INODE) {
+        while (expected >= gone_from && expected < gone_to)
+            expected++;
+
+        name_of(expected++, name);
+        if (strcmp(listed, name) != 0) {
+            check(0, "names listed out of order");
+            return;
+        }
+    }
+    while (expected >= gone_from && expected < gone_to)
+        expected++;
+    check(expected == NAMES, "names missing from the listing");
+}
+
+int main() {
+    char name[MAX_FILE_NAME];
+    int nodes, empty, full_nodes;
+    Directory dir;
+    long before;
+
+    init_fs();
+    before = directory_bytes();
+    directory_create(&dir);
+
+    for (int i = 0; i < NAMES; i++) {
+        name_of(i, name);
+        check(directory_add(&dir, i + 1, name) == SUCCESS, "add failed");
+
+        if (i + 1 == DIR_TREE_THRESHOLD)
+            check(dir.kind == DIR_ARRAY, "not an array at the threshold");
+        if (i + 1 == DIR_TREE_THRESHOLD + 1)
+            check(dir.kind == DIR_TREE, "not a tree past the threshold");
+    }
+
+    check_names(&dir, 0, 0);
+
+    nodes = empty = 0;
+    count_nodes(dir.u.tree.root, &nodes, &empty);
+    check(!dir.u.tree.root->leaf, "tree of one node");
+    full_nodes = nodes;
+
+    /* whole leaves in the middle lose all their names */
+    for (int i = 100; i < 400; i++) {
+        name_of(i, name);
+        check(directory_remove(&dir, i + 1, name) == SUCCESS, "remove failed");
+    }
+
+    check(dir.kind == DIR_TREE && dir.count == NAMES - 300, "wrong kind or count after the range");
+    check_names(&dir, 100, 400);
+
+    nodes = empty = 0;
+    count_nodes(dir.u.tree.root, &nodes, &empty);
+    check(empty == 0, "empty tree node kept");
+    check(nodes < full_nodes, "no tree node released");
+
+    /* down to half the threshold, then to a single short name */
+    for (int i = 0; i < NAMES && dir.count > 1; i++) {
+        if (i >= 100 && i < 400)
+            continue;
+
+        name_of(i, name);
+        check(directory_remove(&dir, i + 1, name) == SUCCESS, "remove failed");
+
+        if (dir.count == DIR_TREE_THRESHOLD / 2 + 1)
+            check(dir.kind == DIR_TREE, "not a tree above half the threshold");
+        if (dir.count == DIR_TREE_THRESHOLD / 2)
+            check(dir.kind == DIR_ARRAY, "not an array at half the threshold");
+    }
+
+    check(dir.kind == DIR_INLINE, "not inline with one name left");
+    name_of(NAMES - 1, name);
+    check(directory_remove(&dir, NAMES, name) == SUCCESS, "remove of the last name failed");
+    check(directory_is_empty(&dir) == SUCCESS, "not empty");
+    directory_destroy(&dir);
+
+    /* exits advance the epoch every EPOCH_EXIT_PERIOD, and retired blocks go two epochs later */
+    for (int i = 0; i < 3 * EPOCH_EXIT_PERIOD; i++) {
+        epoch_enter();
+        epoch_exit();
+    }
+    check(directory_bytes() == before, "directory blocks not given back");
+
+    destroy_fs();
+
+    printf("dirtest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+/*
+ * Epoch reclamation test: short-lived threads each retire a few blocks,
+ * far fewer than EPOCH_BATCH, and exit; then the blocks retired by the
+ * main thread and by the exited ones must all be freed. Also churns a
+ * directory under a memory limit much smaller than what it retires in
+ * total, so retired blocks must keep coming back under the limit.
+ *
+ * Usage: epochtest
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "fs/operations.h"
+
+#define THREADS 20
+#define CHURN_ROUNDS 2000
+#define CHURN_FILES 40
+
+#define LONG_NAME "a_name_too_long_to_be_kept_in_the_entry_"
+
+static int failures = 0;
+
+static void check(int condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "epochtest: %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * Reads the bytes retired and not freed yet from the epoch statistics.
+ */
+static long pending_bytes() {
+    char *stats = NULL;
+    size_t size;
+    long pending = -1;
+    FILE *fp = open_memstream(&stats, &size);
+
+    epoch_print_stats(fp);
+    fclose(fp);
+    sscanf(stats, "epoch: %*u pending %ld", &pending);
+    free(stats);
+
+    return pending;
+}
+
+static void *retire_few(void *arg) {
+    char name[MAX_FILE_NAME];
+
+    snprintf(name, sizeof(name), "/%s%ld", LONG_NAME, (long) arg);
+    if (create(name, T_DIRECTORY) != SUCCESS || delete(name) != SUCCESS)
+        check(0, "create or delete failed in a thread");
+
+    return NULL;
+}
+
+int main() {
+    pthread_t tid[THREADS];
+    char name[MAX_FILE_NAME];
+
+    /* the caches, and a few times SLAB_CREDIT_BATCH for a thread and the i-node table */
+    slab_set_limit(22 * 1024 * 1024);
+    init_fs();
+
+    for (long i = 0; i < THREADS; i++) {
+        pthread_create(&tid[i], NULL, retire_few, (void *) i);
+        pthread_join(tid[i], NULL);
+    }
+
+    /* with no reader around, exiting threads leave nothing behind */
+    check(pending_bytes() == 0, "blocks of exited threads not freed");
+
+    create("/churn", T_DIRECTORY);
+    for (int round = 0; round < CHURN_ROUNDS; round++) {
+        for (int i = 0; i < CHURN_FILES; i++) {
+            snprintf(name, sizeof(name), "/churn/%s%d", LONG_NAME, i);
+            if (create(name, T_FILE) != SUCCESS) {
+                check(0, "create failed under the memory limit");
+                round = CHURN_ROUNDS;
+                break;
+            }
+        }
+
+        for (int i = 0; i < CHURN_FILES; i++) {
+            snprintf(name, sizeof(name), "/churn/%s%d", LONG_NAME, i);
+            delete(name);
+        }
+    }
+
+    destroy_fs();
+
+    printf("epochtest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
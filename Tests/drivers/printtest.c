@@ -0,0 +1,128 @@
+/*
+ * Print snapshot test: two threads keep creating and deleting pairs of
+ * names, one in /a and one in /b, always the same one first, while the
+ * main thread dumps the tree with printFS. A dump is taken between two
+ * operations, so whenever it holds the second name of a pair it must
+ * hold the first one too. Each thread puts its first name in a different
+ * directory, so one of them runs against the order the dump walks in, and
+ * files in the root keep the dump between the two directories for long.
+ *
+ * Usage: printtest
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fs/operations.h"
+
+#define PAIRS 16
+#define FILLERS 2000
+#define DUMPS 200
+
+static int failures = 0;
+static int done = 0;
+
+static void check(int condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "printtest: %s\n", what);
+        failures++;
+    }
+}
+
+typedef struct pair_thread {
+    char *first, *second, *prefix;
+} pair_thread_t;
+
+static void *pairs(void *arg) {
+    pair_thread_t *thread = arg;
+    char first[MAX_FILE_NAME], second[MAX_FILE_NAME];
+
+    while (!__atomic_load_n(&done, __ATOMIC_RELAXED)) {
+        for (int i = 0; i < PAIRS; i++) {
+            snprintf(first, sizeof(first), "%s/%s%d", thread->first, thread->prefix, i);
+            snprintf(second, sizeof(second), "%s/%s%d", thread->second, thread->prefix, i);
+            create(first, T_FILE);
+            create(second, T_FILE);
+        }
+
+        /* the second name goes first, so it never stands alone */
+        for (int i = 0; i < PAIRS; i++) {
+            snprintf(first, sizeof(first), "%s/%s%d", thread->first, thread->prefix, i);
+            snprintf(second, sizeof(second), "%s/%s%d", thread->second, thread->prefix, i);
+            delete(second);
+            delete(first);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Checks that every second name of the thread's pairs in a dump comes
+ * with its first name.
+ */
+static void check_dump(char *dump, pair_thread_t *thread) {
+    char first[MAX_FILE_NAME + 2], second[MAX_FILE_NAME + 2];
+
+    for (int i = 0; i < PAIRS; i++) {
+        snprintf(first, sizeof(first), "\n%s/%s%d\n", thread->first, thread->prefix, i);
+        snprintf(second, sizeof(second), "\n%s/%s%d\n", thread->second, thread->prefix, i);
+        if (strstr(dump, second) != NULL && strstr(dump, first) == NULL)
+            check(0, "dump holds the second name of a pair without the first");
+    }
+}
+
+int main() {
+    pair_thread_t threads[2] = { { "/a", "/b", "ab" }, { "/b", "/a", "ba" } };
+    pthread_t tid[2];
+    char file[] = "/tmp/printtestXXXXXX";
+    char name[MAX_FILE_NAME];
+    char dump[65536];
+    size_t size;
+    FILE *fp;
+    int fd;
+
+    init_fs();
+    create("/a", T_DIRECTORY);
+    create("/b", T_DIRECTORY);
+
+    /* printed after /a and before /b, as entries go in name order */
+    for (int i = 0; i < FILLERS; i++) {
+        snprintf(name, sizeof(name), "/a%d", i);
+        create(name, T_FILE);
+    }
+
+    if ((fd = mkstemp(file)) == -1) {
+        perror("printtest: mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    for (int i = 0; i < 2; i++)
+        pthread_create(&tid[i], NULL, pairs, &threads[i]);
+
+    for (int i = 0; i < DUMPS && failures == 0; i++) {
+        printFS(file);
+
+        fp = fopen(file, "r");
+        size = fread(dump + 1, 1, sizeof(dump) - 2, fp);
+        fclose(fp);
+
+        /* every line between newlines, the first one too */
+        dump[0] = '\n';
+        dump[size + 1] = '\0';
+        check_dump(dump, &threads[0]);
+        check_dump(dump, &threads[1]);
+    }
+
+    __atomic_store_n(&done, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < 2; i++)
+        pthread_join(tid[i], NULL);
+
+    unlink(file);
+    destroy_fs();
+
+    printf("printtest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
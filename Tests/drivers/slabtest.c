@@ -0,0 +1,76 @@
+/*
+ * Slab magazine test: a short-lived thread takes a whole page of the
+ * biggest size class, frees it into its magazine and exits. The objects
+ * must go back to the depot, so that the main thread gets them again
+ * without carving another page, and the thread's counters must still
+ * show in the statistics.
+ *
+ * Usage: slabtest
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "fs/operations.h"
+
+/* objects of a SLAB_MAX_SIZE page, fewer than a magazine holds */
+#define PAGE_OBJECTS (SLAB_MAGAZINE_SIZE / 2)
+
+static int failures = 0;
+
+static void check(int condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "slabtest: %s\n", what);
+        failures++;
+    }
+}
+
+static void *alloc_and_exit(void *arg) {
+    void *objects[PAGE_OBJECTS];
+
+    for (int i = 0; i < PAGE_OBJECTS; i++)
+        objects[i] = slab_alloc(SLAB_MAX_SIZE, SLAB_FILES);
+
+    /* all but one stay in the thread's magazine */
+    for (int i = 1; i < PAGE_OBJECTS; i++)
+        slab_free(objects[i], SLAB_MAX_SIZE, SLAB_FILES);
+
+    /* the one kept is charged to this thread */
+    *(void **) arg = objects[0];
+
+    return NULL;
+}
+
+int main() {
+    void *objects[PAGE_OBJECTS], *kept;
+    int size_class = SLAB_CLASS_COUNT - 1;
+    slab_stats_t stats;
+    pthread_t tid;
+    long before;
+
+    init_fs();
+    before = slab_category_bytes(SLAB_FILES);
+
+    pthread_create(&tid, NULL, alloc_and_exit, &kept);
+    pthread_join(tid, NULL);
+
+    slab_get_stats(size_class, &stats);
+    check(stats.pages == 1, "more than one page carved by the thread");
+    check(stats.live == 1 && stats.free == PAGE_OBJECTS - 1, "exited thread's counters lost");
+    check(slab_category_bytes(SLAB_FILES) - before == SLAB_MAX_SIZE, "exited thread's bytes lost");
+
+    slab_free(kept, SLAB_MAX_SIZE, SLAB_FILES);
+    for (int i = 0; i < PAGE_OBJECTS; i++)
+        objects[i] = slab_alloc(SLAB_MAX_SIZE, SLAB_FILES);
+
+    slab_get_stats(size_class, &stats);
+    check(stats.pages == 1, "objects left in the exited thread's magazine");
+
+    for (int i = 0; i < PAGE_OBJECTS; i++)
+        slab_free(objects[i], SLAB_MAX_SIZE, SLAB_FILES);
+    check(slab_category_bytes(SLAB_FILES) == before, "bytes not given back");
+
+    destroy_fs();
+
+    printf("slabtest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
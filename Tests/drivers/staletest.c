@@ -0,0 +1,67 @@
+/*
+ * Stale dentry cache test: caches a name of /a/b for an i-node that has
+ * since become /a itself, as if it had been deleted and recycled above
+ * its old directory, then looks the name up. The cached walk must drop
+ * the entry before locking the i-node it names: built with -DLOCK_DEBUG,
+ * locking /a while holding /a/b aborts.
+ *
+ * Usage: staletest
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "fs/operations.h"
+
+static int failures = 0;
+
+static void check(int condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "staletest: %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * Looks a path up with lookup, which tries the dentry cache first.
+ * Returns: the i-node found, or FAIL
+ */
+static int cached_lookup(char *name) {
+    op_context_t *context = context_get();
+    op_path_t *path = &context->paths[0];
+    int inumber;
+
+    context_begin(context, OP_LOOKUP);
+    inumber = lookup(context, path, context_parse(path, name), LOOKUP);
+    context_unlock_all(context);
+
+    return inumber;
+}
+
+int main() {
+    int a, b;
+
+    init_fs();
+
+    check(create("/a", T_DIRECTORY) == SUCCESS, "create /a");
+    check(create("/a/b", T_DIRECTORY) == SUCCESS, "create /a/b");
+    check(create("/a/b/c", T_FILE) == SUCCESS, "create /a/b/c");
+
+    a = lookup_aux("/a");
+    b = lookup_aux("/a/b");
+    check(a >= 0 && b >= 0, "lookup /a and /a/b");
+
+    /* every name but the stale one is cached as it is */
+    dcache_add(FS_ROOT, inode_get_generation(FS_ROOT), "a", a, inode_get_generation(a));
+    dcache_add(a, inode_get_generation(a), "b", b, inode_get_generation(b));
+    dcache_add(b, inode_get_generation(b), "x", a, inode_get_generation(a));
+
+    check(cached_lookup("/a/b/x") == FAIL, "stale /a/b/x found");
+    check(cached_lookup("/a/b/c") >= 0, "/a/b/c not found after the stale entry");
+
+    /* the stale entry names a live i-node: it is still checked on every hit */
+    check(cached_lookup("/a/b/x") == FAIL, "stale /a/b/x found twice");
+
+    destroy_fs();
+
+    printf("staletest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# Runs every input of a directory against a fresh 3rd iteration server and
+# compares the client output and the tree printed at the end with the
+# expected ones (<input>.out and <input>.tree in the expected directory).
+# An input may come with <input>.args, server arguments to use instead of
+# the number of threads, and <input>.setup, a client input run first whose
+# output isn't compared. Without <input>.tree, only the output is compared.
+# The server and the client must be built.
+#
+# Usage: runServerTests.sh input_dir expected_dir [server_threads]
+
+
+# Exits program if any of the arguments is invalid.
+validate_arguments(){
+
+	if [ ! -d "$1" ]; then
+		echo "ERROR: input directory doesn't exist."
+		exit 1
+	fi
+
+	if [ ! -d "$2" ]; then
+		echo "ERROR: expected output directory doesn't exist."
+		exit 1
+	fi
+
+	if [ $3 -le 0 ]; then
+		echo "ERROR: invalid number of server threads."
+		exit 1
+	fi
+
+	if [ ! -x "${server}" ] || [ ! -x "${client}" ]; then
+		echo "ERROR: build the server and the client first."
+		exit 1
+	fi
+}
+
+############
+### MAIN ###
+############
+
+#Initialize the variables
+inputDir=$1
+expectedDir=$2
+numThreads=${3:-4}
+iteration="$(dirname -- $0)/../3rd_Iteration"
+server=${iteration}/server/tecnicofs
+client=${iteration}/client/tecnicofs-client
+
+validate_arguments ${inputDir} ${expectedDir} ${numThreads}
+
+workDir=$(mktemp -d)
+failures=0
+
+for input in $(ls ${inputDir}/*.txt); do
+
+	#filteredInput is the name of the input without parent directory or extension
+	filteredInput="$(basename -- $input .txt)"
+	socket=${workDir}/${filteredInput}.socket
+
+	serverArgs=${numThreads}
+	if [ -f ${inputDir}/${filteredInput}.args ]; then
+		serverArgs=$(cat ${inputDir}/${filteredInput}.args)
+	fi
+
+	${server} ${serverArgs} ${socket} > ${workDir}/${filteredInput}.server 2>&1 &
+	serverPid=$!
+
+	#wait for the server socket
+	for i in $(seq 1 50); do
+		[ -S ${socket} ] && break
+		sleep 0.1
+	done
+
+	if [ -f ${inputDir}/${filteredInput}.setup ]; then
+		${client} ${inputDir}/${filteredInput}.setup ${socket} > /dev/null
+	fi
+
+	#the client's mount line names the socket, which changes every run
+	${client} ${input} ${socket} | tail -n +2 > ${workDir}/${filteredInput}.out
+	echo "p ${workDir}/${filteredInput}.tree" > ${workDir}/${filteredInput}.print
+	${client} ${workDir}/${filteredInput}.print ${socket} > /dev/null
+
+	kill ${serverPid}
+	wait ${serverPid} 2> /dev/null
+
+	if diff ${expectedDir}/${filteredInput}.out ${workDir}/${filteredInput}.out > /dev/null 2>&1 &&
+	   { [ ! -f ${expectedDir}/${filteredInput}.tree ] ||
+	     diff ${expectedDir}/${filteredInput}.tree ${workDir}/${filteredInput}.tree > /dev/null 2>&1; }; then
+		echo "${filteredInput}: ok"
+	else
+		echo "${filteredInput}: FAILED (output in ${workDir})"
+		failures=$((failures + 1))
+	fi
+
+done
+
+[ ${failures} -eq 0 ] && rm -rf ${workDir}
+exit ${failures}